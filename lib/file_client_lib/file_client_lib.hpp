@@ -1,3 +1,4 @@
 #pragma once
 
-#include "include/file_client.hpp"
\ No newline at end of file
+#include "include/file_client.hpp"
+#include "include/access_log.hpp"
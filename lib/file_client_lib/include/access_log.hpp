@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace file {
+
+struct access_entry_t {
+    // IPv4 address in network byte order
+    uint32_t            host = 0;
+    // Empty if the request could not be parsed
+    std::string_view    method;
+    std::string_view    target;
+    uint8_t             version_major = 1;
+    uint8_t             version_minor = 1;
+    uint16_t            status = 0;
+    // Response with headers as queued for sending
+    uint64_t            bytes = 0;
+    std::string_view    referer;
+    std::string_view    user_agent;
+    // From the start of parsing until the response was queued
+    int64_t             latency_us = 0;
+};
+
+// Access log in combined format with latency in microseconds appended.
+// Workers copy entries into own single-producer rings without locks,
+// a background writer formats them and appends in large writes. When
+// a ring is full the entry is dropped and counted instead of waiting.
+class AccessLog {
+  public:
+    // Starts the writer appending to the file, "-" is standard output.
+    // False if the file could not be opened
+    static bool open(const std::string &path);
+
+    [[nodiscard]] static bool is_enabled();
+
+    static void add(const access_entry_t &entry);
+
+    // Writes out queued entries and stops the writer
+    static void close();
+};
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace file {
+
+enum class Encoding : uint8_t {
+    identity    = 0,
+    gzip        = 1,
+    brotli      = 2
+};
+
+// Encodings in order of preference, identity is always acceptable
+const Encoding preferred_encodings[] = {Encoding::brotli, Encoding::gzip};
+
+// Set of encodings with non-zero quality in Accept-Encoding value
+uint8_t parse_accept_encoding(std::string_view value);
+
+[[nodiscard]] inline bool is_accepted(uint8_t accepted, Encoding encoding) {
+    return accepted & (1u << (uint8_t)encoding);
+}
+
+// Most preferred of accepted encodings, identity if there are none
+Encoding best_encoding(uint8_t accepted);
+
+// Token for Content-Encoding
+std::string_view encoding_name(Encoding encoding);
+
+// Extension of a precompressed file next to the original one
+std::string_view encoding_extension(Encoding encoding);
+
+// Text types worth compressing
+bool is_compressible(std::string_view content_type);
+
+// False if the data could not be compressed
+bool compress(Encoding encoding, std::string_view data, std::string &compressed);
+
+}
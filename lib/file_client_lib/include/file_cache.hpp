@@ -0,0 +1,156 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "compression.hpp"
+
+namespace fs = std::filesystem;
+
+namespace file {
+
+// Type and validators of a file sent with responses for it
+struct file_meta_t {
+    std::string     content_type;
+    std::string     etag;
+    std::string     last_modified;
+    std::time_t     mtime   = 0;
+    size_t          size    = 0;
+    Encoding        encoding = Encoding::identity;
+    // Response depends on Accept-Encoding
+    bool            vary    = false;
+};
+
+struct cached_file_t {
+    fs::path        path;
+    file_meta_t     meta;
+    // Headers of the full response
+    std::string     headers;
+    // Points into buffer or into storage
+    std::string_view body;
+    std::string     buffer;
+    // Mapping or arena block the body lies in
+    std::shared_ptr<const void> storage;
+    // Of the file at path, the body may be its compressed copy
+    struct timespec mtime;
+    size_t          source_size = 0;
+
+    // Last time the file on disk was compared with the cached copy
+    mutable std::atomic<int64_t> checked_at;
+};
+
+typedef std::shared_ptr<const cached_file_t> cached_file_ptr;
+
+// LRU cache of small files limited by total size of bodies, keyed by
+// path and encoding of the variant. Lookups take a view of the path, so
+// a hit allocates nothing. Entries are checked against mtime and size of
+// the file at most once per revalidate interval, so changed files are
+// dropped on the next hit.
+class FileCache {
+  public:
+    FileCache(size_t max_size, size_t max_file_size);
+
+    FileCache(const FileCache&) = delete;
+    FileCache operator=(const FileCache&) = delete;
+
+    [[nodiscard]] cached_file_ptr get(std::string_view path, Encoding encoding);
+
+    void put(std::string_view path, Encoding encoding, cached_file_ptr file);
+
+    void set_limits(size_t max_size, size_t max_file_size);
+
+    [[nodiscard]] size_t get_max_file_size() const;
+
+    void clear();
+
+    static int64_t now_ms();
+
+  private:
+    static const size_t shards_count = 16;
+
+    struct key_view_t {
+        std::string_view    path;
+        Encoding            encoding;
+    };
+
+    struct key_t {
+        std::string         path;
+        Encoding            encoding;
+
+        operator key_view_t() const { return {path, encoding}; }
+    };
+
+    // Transparent, so maps are searched by views
+    struct key_hash {
+        using is_transparent = void;
+
+        size_t operator()(key_view_t key) const;
+    };
+
+    struct key_equal {
+        using is_transparent = void;
+
+        bool operator()(key_view_t left, key_view_t right) const {
+            return left.encoding == right.encoding && left.path == right.path;
+        }
+    };
+
+    struct entry_t {
+        cached_file_ptr                 file;
+        std::list<key_t>::iterator      lru_pos;
+    };
+
+    struct Shard {
+        std::mutex                                              mutex;
+        std::list<key_t>                                        lru;
+        std::unordered_map<key_t, entry_t, key_hash, key_equal> files;
+        size_t                                                  size = 0;
+    };
+
+    Shard &_shard(key_view_t key);
+
+    void _erase(Shard &shard, key_view_t key, const cached_file_t *file);
+
+    static bool _is_actual(const cached_file_t &file);
+
+    std::atomic<size_t>             _max_size;
+    std::atomic<size_t>             _max_file_size;
+    std::array<Shard, shards_count> _shards;
+};
+
+// Paths known to be absent. Entries expire after the revalidate
+// interval of FileCache, so created files are found soon enough
+class MissCache {
+  public:
+    explicit MissCache(size_t max_entries);
+
+    MissCache(const MissCache&) = delete;
+    MissCache operator=(const MissCache&) = delete;
+
+    [[nodiscard]] bool contains(const std::string &path);
+
+    void put(const std::string &path);
+
+  private:
+    static const size_t shards_count = 16;
+
+    struct Shard {
+        std::mutex                                  mutex;
+        std::unordered_map<std::string, int64_t>    added_at;
+    };
+
+    Shard &_shard(const std::string &path);
+
+    size_t                          _max_shard_entries;
+    std::array<Shard, shards_count> _shards;
+};
+
+}
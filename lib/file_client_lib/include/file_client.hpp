@@ -4,66 +4,106 @@
 
 #include "tcp_server_lib.hpp"
 #include "file_system.hpp"
+#include "http_parser.hpp"
+#include "http_range.hpp"
+#include "response_builder.hpp"
 
 namespace file {
 
-struct request_t;
-
-struct FileClient : public bstcp::IServerClient {
+struct FileClient : public bstcp::CoroutineClient {
   public:
     FileClient() = delete;
 
     explicit FileClient(BaseSocket &&socket)
-            : _socket(std::move(socket))
-            , _files(fs::current_path()) {}
+            : CoroutineClient(std::move(socket))
+            , _files(Filesystem::current()) {}
 
     FileClient(const FileClient &) = delete;
 
     FileClient operator=(const FileClient &) = delete;
 
     FileClient(FileClient &&clt) noexcept
-            : _socket(std::move(clt._socket))
-            , _files(fs::current_path()) {}
+            : CoroutineClient(std::move(clt))
+            , _files(Filesystem::current())
+            , _parser(clt._parser)
+            , _path(std::move(clt._path))
+            , _ranges(std::move(clt._ranges))
+            , _response(std::move(clt._response))
+            , _keep_alive(clt._keep_alive)
+            , _requests_served(clt._requests_served)
+            , _status(clt._status) {}
 
     FileClient &operator=(const FileClient &&) = delete;
 
     ~FileClient() override = default;
 
-    void handle_request() override;
+    // Number of requests served over one connection before it is closed
+    static void set_max_requests(size_t max_requests);
 
-    [[nodiscard]] uint32_t get_host() const override;
+    // Path answered with bstcp::Metrics instead of a file, empty disables it
+    static void set_metrics_path(std::string path);
 
-    [[nodiscard]] uint16_t get_port() const override;
+  private:
+    bstcp::Session serve() override;
 
-    [[nodiscard]] bstcp::SocketStatus get_status() const override;
 
-    bstcp::SocketStatus disconnect() final;
+    void _make_response(const http_request_t &request);
 
-    bool recv_from(void *buffer, int size) override;
+    void _make_error_response(uint16_t code);
 
-    bool send_to(const void *buffer, int size) const override;
+    // Answers with the whole file, its ranges or not modified status;
+    // the body is taken from the cached copy if there is one, otherwise
+    // from the opened file which is closed or given to the output
+    void _make_file_response(const http_request_t &request, const file_meta_t &meta,
+                             const cached_file_ptr &cached, int fd);
 
-    [[nodiscard]] SocketType get_type() const override;
+    // Cached variant in the best encoding the client accepts
+    [[nodiscard]] cached_file_ptr _get_cached(const std::string &url,
+                                              uint8_t accepted) const;
 
-    socket_t get_socket() override;
+    // Sends precompressed file or compressed cached copy instead of the
+    // opened one, false if there is no such variant and file is left open
+    bool _make_encoded_response(const http_request_t &request, uint8_t accepted,
+                                const requested_file_t &file,
+                                const file_meta_t &meta);
 
-    [[nodiscard]] socket_addr_in get_address() const;
+    void _push_ranges(const file_meta_t &meta, const cached_file_ptr &cached, int fd);
 
-    [[nodiscard]] bool is_allow_to_read(long timeout) const override;
+    void _push_body(const cached_file_ptr &cached, int fd, const byte_range_t &range);
 
-    [[nodiscard]] bool is_allow_to_write(long timeout) const override;
+    void _push_cached(cached_file_ptr file, bool with_body);
 
-    [[nodiscard]] bool is_allow_to_rwrite(long timeout) const override;
+    void _make_metrics_response(const http_request_t &request);
 
-  private:
+    // Starts the head of a response, remembers its code for the access log
+    void _start(Status status);
+
+    // Queues the head made by _response
+    void _push_head();
+
+    // Head without a body
+    void _push_empty(Status status);
+
+    // Request is nullptr if it could not be parsed
+    void _log_access(const http_request_t *request, size_t pushed_before,
+                     int64_t start);
 
-    status accept(const std::unique_ptr<ISocket>& server_socket) override;
+    // Answers requests in input until it needs more of it, the output is
+    // full or the connection has to be closed. False if it needs more input
+    bool _process_input();
 
-    std::string _parse_request(std::string &data);
+    const file::Filesystem &_files;
 
-    BaseSocket _socket;
+    HttpParser          _parser;
+    std::string         _path;
+    std::vector<byte_range_t> _ranges;
+    ResponseBuilder     _response;
+    bool                _keep_alive = true;
+    size_t              _requests_served = 0;
+    uint16_t            _status = 0;
 
-    file::Filesystem _files;
+    static size_t       _max_requests;
+    static std::string  _metrics_path;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+namespace file {
+
+// Where bodies of cached files are kept
+enum class BodySource : uint8_t {
+    // Read into own buffer of each file
+    read    = 0,
+    // Small files are copied into FileArena, others are mapped
+    mmap    = 1
+};
+
+// Read-only shared mapping of a whole file, unmapped with the last
+// reference. Reading a truncated file through it raises SIGBUS, so only
+// files sent as they are should be mapped: the kernel fails such send.
+class FileMapping {
+  public:
+    FileMapping(const FileMapping&) = delete;
+    FileMapping operator=(const FileMapping&) = delete;
+
+    ~FileMapping();
+
+    // Nullptr if the file could not be mapped
+    static std::shared_ptr<const FileMapping> map(int fd, size_t size);
+
+    [[nodiscard]] std::string_view data() const;
+
+  private:
+    FileMapping(void *address, size_t size);
+
+    void    *_address;
+    size_t  _size;
+};
+
+// Small files packed one after another into large anonymous blocks, so
+// they share a few TLB entries. Blocks are huge pages when the system
+// reserved them and transparent huge page candidates otherwise. A block
+// is unmapped when no file placed in it is used anymore.
+class FileArena {
+  public:
+    explicit FileArena(size_t block_size);
+
+    FileArena(const FileArena&) = delete;
+    FileArena operator=(const FileArena&) = delete;
+
+    // Copies the file into the arena, false if it could not be read.
+    // Owner keeps the body alive
+    bool load(int fd, size_t size, std::string_view &body,
+              std::shared_ptr<const void> &owner);
+
+    [[nodiscard]] size_t get_max_file_size() const;
+
+  private:
+    struct Block {
+        Block(char *address, size_t size);
+
+        Block(const Block&) = delete;
+        Block operator=(const Block&) = delete;
+
+        ~Block();
+
+        char    *address;
+        size_t  size;
+        size_t  used = 0;
+    };
+
+    std::shared_ptr<Block> _make_block() const;
+
+    size_t                  _block_size;
+    std::mutex              _mutex;
+    std::shared_ptr<Block>  _current;
+};
+
+}
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
+#include <mutex>
+#include <thread>
 
-namespace fs = std::filesystem;
+#include "file_cache.hpp"
+#include "file_mapping.hpp"
+#include "manifest.hpp"
 
 namespace file {
 
@@ -12,21 +17,114 @@ enum file_status: uint8_t {
     forbidden   = 2
 };
 
+enum class PathStatus : uint8_t {
+    ok          = 0,
+    // Dot-dot segments lead above the root
+    above_root  = 1,
+    // Decoded NUL would cut the path given to the kernel, so the opened
+    // file would differ from the one the path names for type and cache
+    invalid     = 2
+};
+
 struct requested_file_t {
-    fs::path path;
+    fs::path    path;
+    // Normalized path of the file below the root
+    std::string relative;
     file_status status;
+    // Opened regular file if status is correct, owned by the caller
+    int         fd = -1;
+    struct stat info{};
+    file_meta_t meta;
 };
 
+// Opens path below dir_fd for reading, neither dot segments nor symbolic
+// links may lead outside of it. Flags are added to O_RDONLY | O_CLOEXEC
+int open_beneath(int dir_fd, const char *path, int flags = 0);
+
+// Files below the root directory. Paths are resolved from a descriptor
+// of the root with openat2(RESOLVE_BENEATH), so neither dot segments nor
+// symbolic links lead outside of it.
 class Filesystem {
   public:
     explicit Filesystem(const std::string& root_dir);
 
+    Filesystem(const Filesystem&) = delete;
+    Filesystem operator=(const Filesystem&) = delete;
+
+    ~Filesystem();
+
+    // Shared instance for the working directory
+    static Filesystem &current();
+
+    // Serves files from a manifest of the root built now and rebuilt on
+    // SIGHUP or changes reported by inotify, so requests do not touch the
+    // filesystem. Blocks SIGHUP in the calling thread, so it has to be
+    // called before other threads start. False if the root was not scanned
+    bool enable_manifest();
+
+    // Manifest in use, nullptr if files are looked up on each request.
+    // Every thread keeps own copy of the pointer and takes the lock only
+    // when a new manifest is published, so lookups share nothing; the
+    // reference stays valid until the next call in the same thread
+    [[nodiscard]] const manifest_ptr &get_manifest() const;
+
+    // Opens the file or index.html of the directory at normalized path
     [[nodiscard]] requested_file_t get_file(const std::string& path) const;
 
-    static std::string encode_file_type(const std::string &extension);
+    // Opens regular file at normalized path, -1 if there is no such file
+    int open_file(const std::string& path, struct stat &info) const;
+
+    // Cached files are shared by all clients of this root and keyed by
+    // normalized path and encoding of the variant
+    [[nodiscard]] cached_file_ptr get_cached(std::string_view path,
+                                             Encoding encoding = Encoding::identity) const;
+
+    void put_cached(std::string_view path, cached_file_ptr file,
+                    Encoding encoding = Encoding::identity) const;
+
+    [[nodiscard]] size_t get_max_cached_file_size() const;
+
+    void set_cache_limits(size_t max_size, size_t max_file_size);
+
+    // Source of bodies of files cached after the call
+    static void set_body_source(BodySource source);
+
+    // Puts size bytes of the opened file into body of the cached file,
+    // false if they could not be read
+    static bool load_body(int fd, size_t size, cached_file_t &file);
+
+    // Makes request path relative to the root in place: drops empty and
+    // dot segments and applies dot-dot ones, keeps the trailing slash
+    static PathStatus normalize(std::string& path);
+
+    // Extension with the dot, empty if files of the type are not served
+    static std::string_view encode_file_type(std::string_view extension);
+
+    // Metadata of the opened file at the path
+    static file_meta_t get_meta(const fs::path& path, const struct stat &info);
 
   private:
-    fs::path _root_dir;
+    static FileArena& _arena();
+
+    [[nodiscard]] requested_file_t _get_indexed(const Manifest &manifest,
+                                                const std::string& path) const;
+
+    // Rebuilds the manifest until the destructor wakes it up
+    void _watch(int signal_fd, int notify_fd);
+
+    fs::path                        _root_dir;
+    int                             _root_fd;
+    // Keyed by paths below this root only
+    mutable FileCache               _cache;
+    mutable MissCache               _misses;
+
+    // Changed with every published manifest, unique among all instances;
+    // 0 while there is no manifest
+    std::atomic<uint64_t>           _generation = 0;
+    mutable std::mutex              _manifest_mutex;
+    manifest_ptr                    _manifest;
+    int                             _wake_fd = -1;
+    std::thread                     _watcher;
 };
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+#include <string_view>
+
+namespace file {
+
+// Size of IMF-fixdate
+constexpr size_t http_date_size = 29;
+
+// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string format_http_date(std::time_t time);
+
+// Writes IMF-fixdate of the current second to out of http_date_size bytes.
+// The date is formatted once a second by a thread started with the first
+// call and is copied without locks
+void get_current_http_date(char *out);
+
+// Accepts IMF-fixdate and the obsolete RFC 850 and asctime forms
+bool parse_http_date(std::string_view value, std::time_t &time);
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace file {
+
+const size_t max_request_line_size  = 8 * 1024;
+const size_t max_request_head_size  = 16 * 1024;
+const size_t max_headers_count      = 32;
+
+struct http_header_t {
+    std::string_view name;
+    std::string_view value;
+};
+
+struct http_request_t {
+    std::string_view    method;
+    std::string_view    target;
+    std::string_view    path;
+    std::string_view    query;
+    uint8_t             version_major = 0;
+    uint8_t             version_minor = 0;
+
+    std::array<http_header_t, max_headers_count>    headers;
+    size_t                                          headers_count = 0;
+
+    // Size of request line and headers in buffer
+    size_t              size = 0;
+
+    // Case-insensitive lookup, empty if header is absent
+    [[nodiscard]] std::string_view header(std::string_view name) const;
+};
+
+enum class ParseStatus : uint8_t {
+    need_more   = 0,
+    complete    = 1,
+    error       = 2
+};
+
+// Incremental parser of request line and headers. Works over the buffer
+// of a connection: every call gets the buffer from the start of request
+// and continues from the place where the previous call stopped.
+// Keeps only offsets, so the buffer may be reallocated between calls.
+class HttpParser {
+  public:
+    HttpParser() = default;
+
+    ParseStatus parse(std::string_view data);
+
+    // Valid after complete status while data buffer is not changed
+    [[nodiscard]] const http_request_t &get_request() const;
+
+    // HTTP status code to answer with after error status
+    [[nodiscard]] uint16_t get_error() const;
+
+    void reset();
+
+  private:
+    enum class state_t : uint8_t {
+        start,
+        method,
+        target,
+        version,
+        line_lf,
+        header_start,
+        header_name,
+        header_value_start,
+        header_value,
+        header_lf,
+        head_lf
+    };
+
+    struct span_t {
+        uint32_t begin = 0;
+        uint32_t end   = 0;
+    };
+
+    struct header_span_t {
+        span_t name;
+        span_t value;
+    };
+
+    ParseStatus _error(uint16_t code);
+
+    uint16_t _finish_request_line(std::string_view data);
+
+    void _fill_request(std::string_view data);
+
+    state_t     _state  = state_t::start;
+    size_t      _pos    = 0;
+    uint16_t    _error_code = 0;
+
+    span_t      _method;
+    span_t      _target;
+    span_t      _version;
+
+    std::array<header_span_t, max_headers_count>    _headers;
+    size_t                                          _headers_count = 0;
+    header_span_t                                   _header;
+
+    http_request_t _request;
+};
+
+}
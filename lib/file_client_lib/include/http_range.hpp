@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace file {
+
+// More ranges in one request are ignored and the whole file is sent
+const size_t max_ranges_count = 16;
+
+struct byte_range_t {
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+enum class RangeStatus : uint8_t {
+    // Header is absent, malformed or not worth serving as ranges
+    none            = 0,
+    satisfiable     = 1,
+    unsatisfiable   = 2
+};
+
+// Parses value of Range header for a file of the given size. Ranges
+// keep order of the request; ones starting past the end are dropped
+RangeStatus parse_ranges(std::string_view value, size_t size,
+                         std::vector<byte_range_t> &ranges);
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_cache.hpp"
+
+namespace file {
+
+struct manifest_entry_t {
+    // Normalized path below the root
+    std::string     relative;
+    fs::path        path;
+    // Kept open while the manifest lives, responses use its duplicates
+    int             fd = -1;
+    struct stat     info{};
+    file_meta_t     meta;
+};
+
+// Immutable index of regular files below the root made by a single scan.
+// Directories map to their index.html. Symbolic links are served only if
+// they point to regular files below the root.
+class Manifest {
+  public:
+    Manifest() = default;
+
+    Manifest(const Manifest&) = delete;
+    Manifest operator=(const Manifest&) = delete;
+
+    ~Manifest();
+
+    // Scans directories in parallel, nullptr if some file could not be opened
+    static std::shared_ptr<const Manifest> build(const fs::path &root, int root_fd);
+
+    // Entry of the file or of the index of the directory at normalized path,
+    // nullptr if there is none. Exists is true for directories without index
+    [[nodiscard]] const manifest_entry_t *find(std::string_view path, bool &exists) const;
+
+    [[nodiscard]] const std::vector<std::string> &get_directories() const;
+
+    [[nodiscard]] size_t get_files_count() const;
+
+  private:
+    static const uint32_t no_entry = UINT32_MAX;
+
+    struct key_t {
+        std::string path;
+        uint32_t    entry;
+    };
+
+    void _add_key(std::string path, uint32_t entry);
+
+    void _build_slots();
+
+    std::vector<manifest_entry_t>   _entries;
+    std::vector<key_t>              _keys;
+    // Open addressing over keys, index plus one or zero for empty slot
+    std::vector<uint32_t>           _slots;
+    size_t                          _mask = 0;
+    std::vector<std::string>        _directories;
+};
+
+typedef std::shared_ptr<const Manifest> manifest_ptr;
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace file {
+
+struct mime_type_t {
+    std::string_view extension;
+    std::string_view type;
+};
+
+// Files of other types are not served. Extensions are lowercase
+// and without the dot; the table below is rebuilt by the compiler.
+inline constexpr mime_type_t mime_types[] = {
+        {"html",    "text/html"},
+        {"htm",     "text/html"},
+        {"css",     "text/css"},
+        {"txt",     "text/plain"},
+        {"csv",     "text/csv"},
+        {"xml",     "text/xml"},
+        {"js",      "application/javascript"},
+        {"mjs",     "application/javascript"},
+        {"json",    "application/json"},
+        {"wasm",    "application/wasm"},
+        {"pdf",     "application/pdf"},
+        {"swf",     "application/x-shockwave-flash"},
+        {"jpeg",    "image/jpeg"},
+        {"jpg",     "image/jpeg"},
+        {"png",     "image/png"},
+        {"gif",     "image/gif"},
+        {"webp",    "image/webp"},
+        {"avif",    "image/avif"},
+        {"svg",     "image/svg+xml"},
+        {"ico",     "image/x-icon"},
+        {"woff",    "font/woff"},
+        {"woff2",   "font/woff2"},
+        {"ttf",     "font/ttf"},
+        {"mp4",     "video/mp4"},
+        {"webm",    "video/webm"},
+        {"mp3",     "audio/mpeg"},
+};
+
+// Perfect hash over the extensions: the seed is searched at compile time
+// until every extension gets its own slot, so a lookup is one hash and
+// at most one comparison
+class MimeTable {
+  public:
+    static constexpr size_t types_count = std::size(mime_types);
+    static constexpr size_t slots_count = 128;
+
+    static_assert(types_count * 2 <= slots_count);
+
+    constexpr MimeTable() {
+        for (uint32_t seed = 1; seed < max_seed; ++seed) {
+            if (_build(seed)) {
+                _seed = seed;
+                return;
+            }
+        }
+    }
+
+    [[nodiscard]] constexpr bool is_valid() const {
+        return _seed != 0;
+    }
+
+    // Case-insensitive, empty if the type is unknown
+    [[nodiscard]] constexpr std::string_view find(std::string_view extension) const {
+        auto slot = _slots[_hash(extension, _seed) % slots_count];
+        if (slot == 0) {
+            return {};
+        }
+
+        const auto &mime = mime_types[slot - 1];
+        if (mime.extension.size() != extension.size()) {
+            return {};
+        }
+        for (size_t i = 0; i < extension.size(); ++i) {
+            if (_lower(extension[i]) != mime.extension[i]) {
+                return {};
+            }
+        }
+        return mime.type;
+    }
+
+  private:
+    static constexpr uint32_t max_seed = 1u << 16;
+
+    static constexpr char _lower(char c) {
+        return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+    }
+
+    static constexpr uint32_t _hash(std::string_view str, uint32_t seed) {
+        uint32_t hash = 2166136261u ^ seed;
+        for (char c: str) {
+            hash = (hash ^ (uint8_t)_lower(c)) * 16777619u;
+        }
+        return hash ^ (hash >> 15);
+    }
+
+    constexpr bool _build(uint32_t seed) {
+        _slots = {};
+        for (size_t i = 0; i < types_count; ++i) {
+            auto &slot = _slots[_hash(mime_types[i].extension, seed) % slots_count];
+            if (slot != 0) {
+                return false;
+            }
+            slot = (uint8_t)(i + 1);
+        }
+        return true;
+    }
+
+    uint32_t                            _seed = 0;
+    std::array<uint8_t, slots_count>    _slots{};
+};
+
+inline constexpr MimeTable mime_table;
+
+static_assert(mime_table.is_valid(), "no perfect hash seed for mime_types");
+static_assert(mime_table.find("CSS") == "text/css");
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace file {
+
+enum class Status : uint8_t {
+    ok                      = 0,
+    partial_content         = 1,
+    not_modified            = 2,
+    bad_request             = 3,
+    forbidden               = 4,
+    not_found               = 5,
+    method_not_allowed      = 6,
+    uri_too_long            = 7,
+    range_not_satisfiable   = 8,
+    headers_too_large       = 9,
+    version_not_supported   = 10,
+    count                   = 11
+};
+
+uint16_t status_code(Status status);
+
+// Head of a response written into a buffer of the connection. Status line
+// with the common headers is copied from a template made at compile time,
+// numbers are written with to_chars, so the buffer is allocated only when
+// a head outgrows it.
+class ResponseBuilder {
+  public:
+    ResponseBuilder();
+
+    // Status line, Connection, Server and Date headers of a new head
+    void start(Status status, bool keep_alive);
+
+    void header(std::string_view name, std::string_view value);
+
+    void header(std::string_view name, uint64_t value);
+
+    void append(std::string_view data);
+
+    void append(uint64_t value);
+
+    // Empty line ending the head
+    void finish();
+
+    [[nodiscard]] std::string_view view() const;
+
+    [[nodiscard]] size_t size() const;
+
+    void clear();
+
+  private:
+    std::string _buffer;
+};
+
+}
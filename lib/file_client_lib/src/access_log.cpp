@@ -0,0 +1,316 @@
+#include "access_log.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tcp_server_lib.hpp"
+
+namespace file {
+
+static const size_t ring_capacity = 1024;
+static const size_t record_text_size = 464;
+static const size_t max_method_size = 16;
+static const size_t max_header_size = 128;
+static const size_t write_batch_size = 64 * 1024;
+static const auto flush_interval = std::chrono::milliseconds(50);
+
+namespace {
+
+// Fixed size, so a ring is a plain array and the owner never allocates
+struct record_t {
+    int64_t     time_ms;
+    int64_t     latency_us;
+    uint64_t    bytes;
+    uint32_t    host;
+    uint16_t    status;
+    uint8_t     version_major;
+    uint8_t     version_minor;
+    // Method, referer, user agent and target one after another, truncated
+    uint16_t    method_size;
+    uint16_t    referer_size;
+    uint16_t    agent_size;
+    uint16_t    target_size;
+    char        text[record_text_size];
+};
+
+// Written only by the owner thread, read only by the writer
+struct ring_t {
+    std::array<record_t, ring_capacity> records;
+    alignas(64) std::atomic<uint64_t>   head{0};
+    alignas(64) std::atomic<uint64_t>   tail{0};
+};
+
+struct log_t {
+    std::mutex                              mutex;
+    std::condition_variable                 wake;
+    std::vector<std::shared_ptr<ring_t>>    rings;
+    std::thread                             writer;
+    bool                                    stop = false;
+    // Some ring is half full, the writer drains before its interval ends
+    bool                                    pending = false;
+    int                                     fd = -1;
+
+    std::atomic<bool>                       enabled = false;
+};
+
+// Never destroyed: workers may log while static destructors run
+log_t &state() {
+    static auto *log = new log_t();
+    return *log;
+}
+
+thread_local std::shared_ptr<ring_t> local_ring;
+
+class Formatter {
+  public:
+    void append(const record_t &record, std::string &out) {
+        char host[INET_ADDRSTRLEN] = "-";
+        inet_ntop(AF_INET, &record.host, host, sizeof(host));
+        out += host;
+        out += " - - [";
+        out += _date(record.time_ms / 1000);
+        out += "] \"";
+
+        std::string_view text(record.text, record_text_size);
+        auto method = text.substr(0, record.method_size);
+        text.remove_prefix(record.method_size);
+        auto referer = text.substr(0, record.referer_size);
+        text.remove_prefix(record.referer_size);
+        auto agent = text.substr(0, record.agent_size);
+        text.remove_prefix(record.agent_size);
+        auto target = text.substr(0, record.target_size);
+
+        if (method.empty()) {
+            out += "-";
+        } else {
+            _escape(method, out);
+            out += ' ';
+            _escape(target, out);
+            out += " HTTP/";
+            out += std::to_string(record.version_major) + "."
+                   + std::to_string(record.version_minor);
+        }
+        out += "\" " + std::to_string(record.status)
+               + " " + std::to_string(record.bytes) + " \"";
+        _escape_or_dash(referer, out);
+        out += "\" \"";
+        _escape_or_dash(agent, out);
+        out += "\" " + std::to_string(record.latency_us) + "\n";
+    }
+
+  private:
+    const char *_date(int64_t seconds) {
+        if (seconds != _second) {
+            _second = seconds;
+            auto time = (std::time_t)seconds;
+            std::tm tm{};
+            gmtime_r(&time, &tm);
+            strftime(_formatted, sizeof(_formatted), "%d/%b/%Y:%H:%M:%S +0000", &tm);
+        }
+        return _formatted;
+    }
+
+    // Quotes and bytes a terminal could interpret are escaped as in httpd
+    static void _escape(std::string_view value, std::string &out) {
+        for (char c: value) {
+            auto byte = (unsigned char)c;
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (byte < 0x20 || byte >= 0x7f) {
+                char hex[5];
+                snprintf(hex, sizeof(hex), "\\x%02x", byte);
+                out += hex;
+            } else {
+                out += c;
+            }
+        }
+    }
+
+    static void _escape_or_dash(std::string_view value, std::string &out) {
+        if (value.empty()) {
+            out += '-';
+        } else {
+            _escape(value, out);
+        }
+    }
+
+    int64_t _second = -1;
+    char    _formatted[40] = "";
+};
+
+void write_all(int fd, std::string &buffer) {
+    size_t done = 0;
+    while (done < buffer.size()) {
+        auto written = write(fd, buffer.data() + done, buffer.size() - done);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            // Entries are lost rather than blocking the writer forever
+            break;
+        }
+        done += written;
+    }
+    buffer.clear();
+}
+
+void drain(ring_t &ring, Formatter &formatter, std::string &buffer, int fd) {
+    auto head = ring.head.load(std::memory_order_relaxed);
+    auto tail = ring.tail.load(std::memory_order_acquire);
+    for (; head < tail; ++head) {
+        formatter.append(ring.records[head % ring_capacity], buffer);
+        if (buffer.size() >= write_batch_size) {
+            ring.head.store(head + 1, std::memory_order_release);
+            write_all(fd, buffer);
+        }
+    }
+    ring.head.store(head, std::memory_order_release);
+}
+
+void writer_main(log_t &log) {
+    Formatter formatter;
+    std::string buffer;
+    buffer.reserve(write_batch_size * 2);
+
+    std::unique_lock lock(log.mutex);
+    while (true) {
+        log.wake.wait_for(lock, flush_interval,
+                          [&log] { return log.stop || log.pending; });
+        log.pending = false;
+        bool stopping = log.stop;
+        auto rings = log.rings;
+        lock.unlock();
+
+        for (auto &ring: rings) {
+            drain(*ring, formatter, buffer, log.fd);
+        }
+        if (!buffer.empty()) {
+            write_all(log.fd, buffer);
+        }
+        rings.clear();
+
+        lock.lock();
+        // Rings of finished threads are kept until they are written out
+        std::erase_if(log.rings, [](const std::shared_ptr<ring_t> &ring) {
+            return ring.use_count() == 1
+                   && ring->head.load(std::memory_order_relaxed)
+                      == ring->tail.load(std::memory_order_acquire);
+        });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+}
+
+bool AccessLog::open(const std::string &path) {
+    auto &log = state();
+    std::lock_guard lock(log.mutex);
+    if (log.writer.joinable()) {
+        return true;
+    }
+
+    int fd = path == "-"
+             ? fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0)
+             : ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+
+    log.fd = fd;
+    log.stop = false;
+    log.pending = false;
+    log.writer = std::thread(writer_main, std::ref(log));
+    log.enabled.store(true, std::memory_order_release);
+    return true;
+}
+
+bool AccessLog::is_enabled() {
+    return state().enabled.load(std::memory_order_relaxed);
+}
+
+void AccessLog::add(const access_entry_t &entry) {
+    auto &log = state();
+    if (!local_ring) {
+        local_ring = std::make_shared<ring_t>();
+        std::lock_guard lock(log.mutex);
+        log.rings.push_back(local_ring);
+    }
+
+    auto &ring = *local_ring;
+    auto tail = ring.tail.load(std::memory_order_relaxed);
+    auto head = ring.head.load(std::memory_order_acquire);
+    if (tail - head >= ring_capacity) {
+        bstcp::Metrics::add(bstcp::Counter::log_dropped);
+        return;
+    }
+
+    auto &record = ring.records[tail % ring_capacity];
+    record.time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    record.latency_us = entry.latency_us;
+    record.bytes = entry.bytes;
+    record.host = entry.host;
+    record.status = entry.status;
+    record.version_major = entry.version_major;
+    record.version_minor = entry.version_minor;
+
+    size_t used = 0;
+    auto put = [&record, &used](std::string_view value, size_t limit) {
+        auto size = std::min({value.size(), limit, record_text_size - used});
+        memcpy(record.text + used, value.data(), size);
+        used += size;
+        return (uint16_t)size;
+    };
+    record.method_size = put(entry.method, max_method_size);
+    record.referer_size = put(entry.referer, max_header_size);
+    record.agent_size = put(entry.user_agent, max_header_size);
+    record.target_size = put(entry.target, record_text_size);
+
+    ring.tail.store(tail + 1, std::memory_order_release);
+    // Writer is woken early only when the ring fills up faster than it wakes
+    if (tail + 1 - head == ring_capacity / 2) {
+        {
+            std::lock_guard lock(log.mutex);
+            log.pending = true;
+        }
+        log.wake.notify_one();
+    }
+}
+
+void AccessLog::close() {
+    auto &log = state();
+    log.enabled.store(false, std::memory_order_relaxed);
+
+    std::thread writer;
+    {
+        std::lock_guard lock(log.mutex);
+        if (!log.writer.joinable()) {
+            return;
+        }
+        log.stop = true;
+        writer = std::move(log.writer);
+    }
+    log.wake.notify_one();
+    writer.join();
+
+    ::close(log.fd);
+    log.fd = -1;
+}
+
+}
@@ -0,0 +1,163 @@
+#include "compression.hpp"
+
+#include <zlib.h>
+#include <brotli/encode.h>
+#include <algorithm>
+#include <cctype>
+
+namespace file {
+
+// Every file is compressed once per change, so the levels
+// favour size while keeping the first response fast
+static const int gzip_level = 6;
+static const int brotli_quality = 6;
+
+static std::string_view trim(std::string_view value) {
+    auto first = value.find_first_not_of(" \t");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    return value.substr(first, value.find_last_not_of(" \t") - first + 1);
+}
+
+static bool equals_ignore_case(std::string_view lhs, std::string_view rhs) {
+    return lhs.size() == rhs.size()
+           && std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+                         [](char a, char b) { return tolower(a) == tolower(b); });
+}
+
+// Only zero quality matters, so "q=0", "q=0.0" and so on
+static bool is_zero_quality(std::string_view params) {
+    while (!params.empty()) {
+        auto end = params.find(';');
+        auto param = trim(params.substr(0, end));
+        params = end == std::string_view::npos ? "" : params.substr(end + 1);
+
+        if (param.size() < 2 || tolower(param[0]) != 'q' || param[1] != '=') {
+            continue;
+        }
+        auto value = trim(param.substr(2));
+        return !value.empty()
+               && value.find_first_not_of("0.") == std::string_view::npos;
+    }
+    return false;
+}
+
+uint8_t parse_accept_encoding(std::string_view value) {
+    uint8_t accepted = 0;
+    uint8_t rejected = 0;
+    bool any = false;
+
+    while (!value.empty()) {
+        auto end = value.find(',');
+        auto item = value.substr(0, end);
+        value = end == std::string_view::npos ? "" : value.substr(end + 1);
+
+        auto params = item.find(';');
+        auto coding = trim(item.substr(0, params));
+        bool zero = params != std::string_view::npos
+                    && is_zero_quality(item.substr(params + 1));
+
+        uint8_t mask = 0;
+        if (equals_ignore_case(coding, "br")) {
+            mask = 1u << (uint8_t)Encoding::brotli;
+        } else if (equals_ignore_case(coding, "gzip")
+                   || equals_ignore_case(coding, "x-gzip")) {
+            mask = 1u << (uint8_t)Encoding::gzip;
+        } else if (coding == "*") {
+            any = !zero;
+            continue;
+        }
+        (zero ? rejected : accepted) |= mask;
+    }
+
+    if (any) {
+        accepted |= (1u << (uint8_t)Encoding::brotli) | (1u << (uint8_t)Encoding::gzip);
+    }
+    return accepted & ~rejected;
+}
+
+Encoding best_encoding(uint8_t accepted) {
+    for (auto encoding: preferred_encodings) {
+        if (is_accepted(accepted, encoding)) {
+            return encoding;
+        }
+    }
+    return Encoding::identity;
+}
+
+std::string_view encoding_name(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::gzip:
+            return "gzip";
+        case Encoding::brotli:
+            return "br";
+        default:
+            return "identity";
+    }
+}
+
+std::string_view encoding_extension(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::gzip:
+            return ".gz";
+        case Encoding::brotli:
+            return ".br";
+        default:
+            return "";
+    }
+}
+
+bool is_compressible(std::string_view content_type) {
+    return content_type.substr(0, 5) == "text/"
+           || content_type == "application/javascript";
+}
+
+static bool gzip(std::string_view data, std::string &compressed) {
+    z_stream stream{};
+    // Window bits over 15 make deflate write gzip header and trailer
+    if (deflateInit2(&stream, gzip_level, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    compressed.resize(deflateBound(&stream, data.size()));
+    stream.next_in = (Bytef *)data.data();
+    stream.avail_in = (uInt)data.size();
+    stream.next_out = (Bytef *)compressed.data();
+    stream.avail_out = (uInt)compressed.size();
+
+    auto res = deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    return res == Z_STREAM_END;
+}
+
+static bool brotli(std::string_view data, std::string &compressed) {
+    auto size = BrotliEncoderMaxCompressedSize(data.size());
+    if (size == 0) {
+        return false;
+    }
+    compressed.resize(size);
+    if (!BrotliEncoderCompress(brotli_quality, BROTLI_DEFAULT_WINDOW,
+                               BROTLI_MODE_TEXT, data.size(),
+                               (const uint8_t *)data.data(), &size,
+                               (uint8_t *)compressed.data())) {
+        return false;
+    }
+    compressed.resize(size);
+    return true;
+}
+
+bool compress(Encoding encoding, std::string_view data, std::string &compressed) {
+    switch (encoding) {
+        case Encoding::gzip:
+            return gzip(data, compressed);
+        case Encoding::brotli:
+            return brotli(data, compressed);
+        default:
+            return false;
+    }
+}
+
+}
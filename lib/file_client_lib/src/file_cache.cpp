@@ -0,0 +1,155 @@
+#include "file_cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace file {
+
+static const int64_t revalidate_interval_ms = 1000;
+
+FileCache::FileCache(size_t max_size, size_t max_file_size)
+        : _max_size(max_size)
+        , _max_file_size(max_file_size) {}
+
+int64_t FileCache::now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+size_t FileCache::key_hash::operator()(key_view_t key) const {
+    return std::hash<std::string_view>{}(key.path) ^ (size_t)key.encoding;
+}
+
+FileCache::Shard &FileCache::_shard(key_view_t key) {
+    return _shards[key_hash{}(key) % shards_count];
+}
+
+bool FileCache::_is_actual(const cached_file_t &file) {
+    auto now = now_ms();
+    if (now - file.checked_at.load(std::memory_order_relaxed)
+        < revalidate_interval_ms) {
+        return true;
+    }
+
+    struct stat info{};
+    if (stat(file.path.c_str(), &info) == -1
+        || info.st_mtim.tv_sec != file.mtime.tv_sec
+        || info.st_mtim.tv_nsec != file.mtime.tv_nsec
+        || (size_t)info.st_size != file.source_size) {
+        return false;
+    }
+
+    file.checked_at.store(now, std::memory_order_relaxed);
+    return true;
+}
+
+cached_file_ptr FileCache::get(std::string_view path, Encoding encoding) {
+    if (_max_size == 0) {
+        return nullptr;
+    }
+
+    key_view_t key{path, encoding};
+    auto &shard = _shard(key);
+    cached_file_ptr file;
+    {
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.files.find(key);
+        if (it == shard.files.end()) {
+            return nullptr;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_pos);
+        file = it->second.file;
+    }
+
+    if (!_is_actual(*file)) {
+        std::lock_guard lock(shard.mutex);
+        _erase(shard, key, file.get());
+        return nullptr;
+    }
+    return file;
+}
+
+void FileCache::put(std::string_view path, Encoding encoding, cached_file_ptr file) {
+    key_view_t key{path, encoding};
+    auto max_shard_size = _max_size / shards_count;
+    if (file->body.size() > _max_file_size
+        || file->body.size() > max_shard_size) {
+        return;
+    }
+
+    auto &shard = _shard(key);
+    std::lock_guard lock(shard.mutex);
+    _erase(shard, key, nullptr);
+
+    shard.lru.push_front({std::string(path), encoding});
+    shard.size += file->body.size();
+    shard.files.emplace(shard.lru.front(), entry_t{std::move(file), shard.lru.begin()});
+
+    while (shard.size > max_shard_size && !shard.lru.empty()) {
+        _erase(shard, shard.lru.back(), nullptr);
+    }
+}
+
+void FileCache::_erase(Shard &shard, key_view_t key, const cached_file_t *file) {
+    auto it = shard.files.find(key);
+    if (it == shard.files.end()
+        || (file != nullptr && it->second.file.get() != file)) {
+        return;
+    }
+
+    shard.size -= it->second.file->body.size();
+    shard.lru.erase(it->second.lru_pos);
+    shard.files.erase(it);
+}
+
+void FileCache::set_limits(size_t max_size, size_t max_file_size) {
+    _max_size = max_size;
+    _max_file_size = max_file_size;
+    clear();
+}
+
+size_t FileCache::get_max_file_size() const {
+    return _max_size == 0 ? 0 : _max_file_size.load();
+}
+
+void FileCache::clear() {
+    for (auto &shard: _shards) {
+        std::lock_guard lock(shard.mutex);
+        shard.files.clear();
+        shard.lru.clear();
+        shard.size = 0;
+    }
+}
+
+MissCache::MissCache(size_t max_entries)
+        : _max_shard_entries(std::max<size_t>(max_entries / shards_count, 1)) {}
+
+MissCache::Shard &MissCache::_shard(const std::string &path) {
+    return _shards[std::hash<std::string>{}(path) % shards_count];
+}
+
+bool MissCache::contains(const std::string &path) {
+    auto &shard = _shard(path);
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.added_at.find(path);
+    if (it == shard.added_at.end()) {
+        return false;
+    }
+    if (FileCache::now_ms() - it->second >= revalidate_interval_ms) {
+        shard.added_at.erase(it);
+        return false;
+    }
+    return true;
+}
+
+void MissCache::put(const std::string &path) {
+    auto &shard = _shard(path);
+    std::lock_guard lock(shard.mutex);
+    // Flood of random paths only resets the shard
+    if (shard.added_at.size() >= _max_shard_entries) {
+        shard.added_at.clear();
+    }
+    shard.added_at[path] = FileCache::now_ms();
+}
+
+}
@@ -1,218 +1,651 @@
 #include "file_client.hpp"
 
-#include <fstream>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <iostream>
+#include <cerrno>
+#include <atomic>
+#include <random>
+
+#include "access_log.hpp"
+#include "http_date.hpp"
 
 static const char* GET_METHOD = "GET";
 static const char* HEAD_METHOD = "HEAD";
 
-static const char* STATUS_METHOD_NOT_ALLOWED = "HTTP/1.1 405 Method Not Allowed";
-static const char* STATUS_NOT_FOUND = "HTTP/1.1 404 Not Found";
-static const char* STATUS_FORBIDDEN = "HTTP/1.1 403 Forbidden";
-static const char* STATUS_OK = "HTTP/1.1 200 OK";
 
 static const char * divider = "\r\n";
 
-std::string decode_url(const std::string &url) {
-    std::string decoded_url;
+static const size_t default_max_requests = 1000;
+static const char *default_metrics_path = "/metrics";
+
+static void decode_url(std::string_view url, std::string &decoded_url) {
+    decoded_url.clear();
     for (size_t i = 0; i < url.size(); i++) {
-        if (url[i] == '%') {
-            decoded_url += static_cast<char>(
-                    strtoll(url.substr(i + 1, 2).c_str(), nullptr, 16)
-            );
+        if (url[i] == '%' && i + 2 < url.size() && isxdigit((unsigned char)url[i + 1])
+            && isxdigit((unsigned char)url[i + 2])) {
+            char code[] = {url[i + 1], url[i + 2], '\0'};
+            decoded_url += static_cast<char>(strtol(code, nullptr, 16));
             i = i + 2;
         } else {
             decoded_url += url[i];
         }
     }
-    return decoded_url;
 }
 
-// trim from start (in place)
-static inline void ltrim(std::string &s) {
-    s.erase(s.begin(), std::find_if(s.begin(), s.end(),
-                                    std::not1(std::ptr_fun<int, int>(std::isspace))));
+using namespace file;
+
+static void add_validators(ResponseBuilder &response, const file_meta_t &meta) {
+    response.header("Last-Modified", meta.last_modified);
+    response.header("ETag", meta.etag);
+    if (meta.vary) {
+        response.header("Vary", "Accept-Encoding");
+    }
 }
 
-// trim from end (in place)
-static inline void rtrim(std::string &s) {
-    s.erase(std::find_if(s.rbegin(), s.rend(),
-                         std::not1(std::ptr_fun<int, int>(std::isspace))).base(), s.end());
+// Headers of the whole file up to the end of the head
+static void add_file_headers(ResponseBuilder &response, const file_meta_t &meta) {
+    response.header("Content-Type", meta.content_type);
+    if (meta.encoding == Encoding::identity) {
+        response.header("Accept-Ranges", "bytes");
+    } else {
+        response.header("Content-Encoding", encoding_name(meta.encoding));
+    }
+    add_validators(response, meta);
+    response.header("Content-Length", meta.size);
+    response.finish();
 }
 
-// trim from both ends (in place)
-static inline std::string trim(std::string s) {
-    ltrim(s);
-    rtrim(s);
-    return s;
+// Compressed variant is a separate representation with own tag
+static file_meta_t make_encoded_meta(const file_meta_t &meta, Encoding encoding,
+                                     size_t size) {
+    auto encoded = meta;
+    encoded.encoding = encoding;
+    encoded.size = size;
+    encoded.etag.insert(encoded.etag.size() - 1,
+                        "-" + (std::string)encoding_name(encoding));
+    return encoded;
 }
 
-static const size_t client_chank_size = 1024;
+static void add_content_range(ResponseBuilder &response, const byte_range_t &range,
+                              size_t size) {
+    response.append("Content-Range: bytes ");
+    response.append(range.offset);
+    response.append("-");
+    response.append(range.offset + range.length - 1);
+    response.append("/");
+    response.append(size);
+    response.append(divider);
+}
 
-using namespace file;
+static const size_t boundary_size = 16;
 
-static std::string read_from_socket(bstcp::ISocket &socket, size_t chank_size) {
-    tcp_data_t buffer(chank_size);
+static std::string_view make_boundary(char (&boundary)[boundary_size + 1]) {
+    static const uint64_t seed = [] {
+        std::random_device random;
+        return (uint64_t)random() << 32 | random();
+    }();
+    static std::atomic<uint64_t> counter = 0;
 
-    bool status = socket.recv_from(buffer.data(), (int)chank_size);
-    if (!status) {
-        return "";
-    }
-    std::string res;
-    res.insert(
-            res.end(),
-            std::make_move_iterator(buffer.begin()),
-            std::make_move_iterator(buffer.end())
-    );
-    auto end = res.find('\0');
-    if (end != std::string::npos) {
-        res = res.substr(0, end);
+    snprintf(boundary, sizeof(boundary), "%016lx",
+             (unsigned long)(seed ^ (counter++ * 0x9e3779b97f4a7c15ull)));
+    return {boundary, boundary_size};
+}
+
+static void add_part_head(ResponseBuilder &response, std::string_view boundary,
+                          const file_meta_t &meta, const byte_range_t &range) {
+    response.append(divider);
+    response.append("--");
+    response.append(boundary);
+    response.append(divider);
+    response.header("Content-Type", meta.content_type);
+    add_content_range(response, range, meta.size);
+    response.append(divider);
+}
+
+static void add_part_tail(ResponseBuilder &response, std::string_view boundary) {
+    response.append(divider);
+    response.append("--");
+    response.append(boundary);
+    response.append("--");
+    response.append(divider);
+}
+
+static std::shared_ptr<cached_file_t> make_cached_file(const fs::path& path,
+                                                       const struct stat &info,
+                                                       file_meta_t meta) {
+    auto file = std::make_shared<cached_file_t>();
+    file->path = path;
+    ResponseBuilder headers;
+    add_file_headers(headers, meta);
+    file->headers = headers.view();
+    file->meta = std::move(meta);
+    file->mtime = info.st_mtim;
+    file->source_size = info.st_size;
+    file->checked_at = FileCache::now_ms();
+    return file;
+}
+
+static cached_file_ptr read_file(int fd, const fs::path& path,
+                                 const struct stat &info, file_meta_t meta) {
+    auto file = make_cached_file(path, info, std::move(meta));
+    if (!Filesystem::load_body(fd, info.st_size, *file)) {
+        return nullptr;
     }
+    return file;
+}
 
-    return res;
+static bool equals_ignore_case(std::string_view lhs, std::string_view rhs) {
+    return lhs.size() == rhs.size()
+           && std::equal(lhs.begin(), lhs.end(), rhs.begin(),
+                         [](char a, char b) { return tolower(a) == tolower(b); });
 }
 
-static bool send_to_socket(bstcp::ISocket &socket, const std::string& data) {
-    return socket.send_to(data.data(), (int)data.size());;
+static bool wants_keep_alive(const http_request_t &request) {
+    bool keep_alive = request.version_major > 1
+                      || (request.version_major == 1 && request.version_minor >= 1);
+
+    // Connection header is a comma separated list of options
+    auto value = request.header("Connection");
+    while (!value.empty()) {
+        auto end = value.find(',');
+        auto option = value.substr(0, end);
+        value = end == std::string_view::npos ? "" : value.substr(end + 1);
+
+        auto first = option.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            continue;
+        }
+        option = option.substr(first, option.find_last_not_of(" \t") - first + 1);
+
+        if (equals_ignore_case(option, "close")) {
+            keep_alive = false;
+        } else if (equals_ignore_case(option, "keep-alive")) {
+            keep_alive = true;
+        }
+    }
+    return keep_alive;
 }
 
-std::string read_file(const fs::path& path) {
-    std::ifstream file(path,std::ios::in | std::ios::binary);
-    std::stringstream fl;
-    if (file.is_open()) {
-        fl << file.rdbuf();
+// Weak comparison with every tag of the list, as If-None-Match requires
+static bool etag_matches(std::string_view list, std::string_view etag) {
+    auto opaque = [](std::string_view tag) {
+        return tag.substr(0, 2) == "W/" ? tag.substr(2) : tag;
+    };
+
+    while (!list.empty()) {
+        auto end = list.find(',');
+        auto tag = list.substr(0, end);
+        list = end == std::string_view::npos ? "" : list.substr(end + 1);
+
+        auto first = tag.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            continue;
+        }
+        tag = tag.substr(first, tag.find_last_not_of(" \t") - first + 1);
+        if (tag == "*" || opaque(tag) == opaque(etag)) {
+            return true;
+        }
     }
+    return false;
+}
 
-    file.close();
-    return fl.str();
+static bool is_not_modified(const http_request_t &request, const file_meta_t &meta) {
+    // Date is not checked if the client has tags
+    auto none_match = request.header("If-None-Match");
+    if (!none_match.empty()) {
+        return etag_matches(none_match, meta.etag);
+    }
+
+    std::time_t since;
+    return parse_http_date(request.header("If-Modified-Since"), since)
+           && meta.mtime <= since;
 }
 
-std::string FileClient::_parse_request(std::string &data) {
-    std::string response;
+// Ranges are sent only of the same file If-Range names
+static bool range_applies(const http_request_t &request, const file_meta_t &meta) {
+    auto if_range = request.header("If-Range");
+    if (if_range.empty()) {
+        return true;
+    }
+    if (if_range.front() == '"') {
+        return if_range == meta.etag;
+    }
 
-    auto end = data.find(divider);
-    auto request = data.substr(0, end);
+    std::time_t date;
+    return parse_http_date(if_range, date) && date == meta.mtime;
+}
+
+static bool has_body(const http_request_t &request) {
+    auto length = request.header("Content-Length");
+    return !request.header("Transfer-Encoding").empty()
+           || (!length.empty() && length != "0");
+}
 
-    end = request.find(' ');
-    auto method = trim(request.substr(0, end));
-    auto next_end = request.find('?', end + 1);
-    if (next_end == std::string::npos) {
-        next_end = request.find(' ', end + 1);
+static Status error_status(uint16_t code) {
+    switch (code) {
+        case 414:
+            return Status::uri_too_long;
+        case 431:
+            return Status::headers_too_large;
+        case 505:
+            return Status::version_not_supported;
+        default:
+            return Status::bad_request;
     }
+}
+
+size_t FileClient::_max_requests = default_max_requests;
+
+void FileClient::set_max_requests(size_t max_requests) {
+    _max_requests = max_requests;
+}
+
+std::string FileClient::_metrics_path = default_metrics_path;
+
+void FileClient::set_metrics_path(std::string path) {
+    _metrics_path = std::move(path);
+}
 
-    auto url = decode_url(trim(request.substr(end + 1 , next_end - 1 - end)));
+void FileClient::_start(Status status) {
+    _status = status_code(status);
+    _response.start(status, _keep_alive);
+}
+
+void FileClient::_push_head() {
+    _connection.output().append(_response.view());
+}
+
+void FileClient::_push_empty(Status status) {
+    _start(status);
+    _response.header("Content-Length", 0);
+    _response.finish();
+    _push_head();
+}
+
+void FileClient::_make_error_response(uint16_t code) {
+    _keep_alive = false;
+    _push_empty(error_status(code));
+}
 
-    std::time_t now_time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    auto time = std::string (std::ctime(&now_time));
+void FileClient::_make_response(const http_request_t &request) {
+    auto method = request.method;
+    decode_url(request.path, _path);
+    auto path_status = Filesystem::normalize(_path);
+    const auto &url = _path;
 
-    std::string headers = (std::string)"Connection: close" + divider;
-    headers += (std::string)"Server: httpd" + divider;
-    headers += (std::string)"Date: " + time.substr(0, time.size() - 1) + divider;
+    // Request bodies are not supported, so such connection can not be reused
+    _keep_alive = _requests_served + 1 < _max_requests
+                  && (method == GET_METHOD || method == HEAD_METHOD)
+                  && !has_body(request)
+                  && wants_keep_alive(request);
 
     if (method != GET_METHOD && method != HEAD_METHOD) {
-        response += (std::string)STATUS_METHOD_NOT_ALLOWED + divider + headers + divider;
-        return response;
+        _push_empty(Status::method_not_allowed);
+        return;
+    }
+
+    if (!_metrics_path.empty() && request.path == _metrics_path) {
+        _make_metrics_response(request);
+        return;
+    }
+
+    if (path_status == PathStatus::invalid) {
+        _make_error_response(400);
+        return;
+    }
+    if (path_status == PathStatus::above_root) {
+        _push_empty(Status::not_found);
+        return;
+    }
+
+    auto lookup_start = bstcp::Metrics::now();
+    auto accepted = parse_accept_encoding(request.header("Accept-Encoding"));
+    if (auto cached = _get_cached(url, accepted)) {
+        bstcp::Metrics::record(bstcp::Histogram::lookup_time,
+                               bstcp::Metrics::now() - lookup_start);
+        _make_file_response(request, cached->meta, cached, -1);
+        return;
     }
 
     auto res = _files.get_file(url);
+    bstcp::Metrics::record(bstcp::Histogram::lookup_time,
+                           bstcp::Metrics::now() - lookup_start);
 
     if (res.status == file_status::not_found) {
-        response += (std::string)STATUS_NOT_FOUND + divider + headers + divider;
-        return response;
+        _push_empty(Status::not_found);
+        return;
     }
 
     if (res.status == file_status::forbidden) {
-        response += (std::string)STATUS_FORBIDDEN + divider + headers + divider;
-        return response;
+        _push_empty(Status::forbidden);
+        return;
     }
 
-    auto body = read_file(res.path);
-    if (body.empty()) {
-        response += (std::string)STATUS_NOT_FOUND + divider + headers + divider;
-        return response;
+    const auto &meta = res.meta;
+    if (meta.content_type.empty()) {
+        close(res.fd);
+        _push_empty(Status::forbidden);
+        return;
     }
 
-    auto file_ex = res.path.extension().string();
-    std::transform(file_ex.begin(), file_ex.end(), file_ex.begin(), tolower);
-    auto content_type = Filesystem::encode_file_type(file_ex);
-    if (content_type.empty()) {
-        response += (std::string)STATUS_FORBIDDEN + divider + headers + divider;
-        return response;
+    const auto &info = res.info;
+    int fd = res.fd;
+    if (accepted != 0 && meta.vary
+        && _make_encoded_response(request, accepted, res, meta)) {
+        return;
     }
 
-    headers += "Content-Type: " + content_type + divider;
-    headers += "Content-Length: " + std::to_string(body.size()) + divider;
+    if (method == GET_METHOD
+        && (size_t)info.st_size <= _files.get_max_cached_file_size()) {
+        if (auto file = read_file(fd, res.path, info, meta)) {
+            close(fd);
+            _files.put_cached(url, file);
+            _make_file_response(request, file->meta, file, -1);
+            return;
+        }
+    }
 
-    response += (std::string)STATUS_OK + divider + headers + divider;
-    if (method == GET_METHOD) {
-        response += body;
+    _make_file_response(request, meta, nullptr, fd);
+}
+
+cached_file_ptr FileClient::_get_cached(const std::string &url, uint8_t accepted) const {
+    for (auto encoding: preferred_encodings) {
+        if (!is_accepted(accepted, encoding)) {
+            continue;
+        }
+        if (auto cached = _files.get_cached(url, encoding)) {
+            return cached;
+        }
     }
 
-    return response;
+    auto cached = _files.get_cached(url);
+    if (cached && cached->meta.vary && accepted != 0) {
+        // Compressed variant is not made yet
+        return nullptr;
+    }
+    return cached;
 }
 
+bool FileClient::_make_encoded_response(const http_request_t &request, uint8_t accepted,
+                                        const requested_file_t &file,
+                                        const file_meta_t &meta) {
+    const auto &url = _path;
+    const auto &path = file.path;
+    const auto &info = file.info;
+    int fd = file.fd;
+    auto max_cached_size = _files.get_max_cached_file_size();
+
+    // Precompressed file next to the original is sent as it is
+    for (auto encoding: preferred_encodings) {
+        if (!is_accepted(accepted, encoding)) {
+            continue;
+        }
 
-void FileClient::handle_request() {
-    std::string data = read_from_socket(*this, client_chank_size);
-    if (data.empty()) {
-        return;
+        struct stat encoded_info{};
+        auto extension = encoding_extension(encoding);
+        int encoded_fd = _files.open_file(file.relative + (std::string)extension,
+                                          encoded_info);
+        if (encoded_fd == -1) {
+            continue;
+        }
+        if (encoded_info.st_mtim.tv_sec < info.st_mtim.tv_sec) {
+            // Left from the previous version of the file
+            close(encoded_fd);
+            continue;
+        }
+
+        close(fd);
+        auto encoded_path = path;
+        encoded_path += extension;
+        auto encoded_meta = make_encoded_meta(meta, encoding, encoded_info.st_size);
+        if ((size_t)encoded_info.st_size <= max_cached_size) {
+            if (auto file = read_file(encoded_fd, encoded_path, encoded_info,
+                                      encoded_meta)) {
+                close(encoded_fd);
+                _files.put_cached(url, file, encoding);
+                _make_file_response(request, file->meta, file, -1);
+                return true;
+            }
+        }
+        _make_file_response(request, encoded_meta, nullptr, encoded_fd);
+        return true;
     }
 
-   /* std::cout << "Client " << " send data [ " << data.size()
-              << " bytes ]: \n" << (char *) data.data() << '\n';*/
-    auto res = _parse_request(data);
+    // Others are compressed once and kept in the cache until they change
+    if (meta.size > max_cached_size) {
+        return false;
+    }
+    auto original = read_file(fd, path, info, meta);
+    if (!original) {
+        return false;
+    }
+    close(fd);
+    _files.put_cached(url, original);
+
+    auto encoding = best_encoding(accepted);
+    std::string compressed;
+    cached_file_ptr variant = original;
+    if (compress(encoding, original->body, compressed)
+        && compressed.size() < original->body.size()) {
+        auto encoded = make_cached_file(
+                path, info, make_encoded_meta(meta, encoding, compressed.size()));
+        encoded->buffer = std::move(compressed);
+        encoded->body = encoded->buffer;
+        variant = std::move(encoded);
+    }
 
-    send_to_socket(*this, res);
+    // Variant that does not compress is the original itself
+    _files.put_cached(url, variant, encoding);
+    _make_file_response(request, variant->meta, variant, -1);
+    return true;
 }
 
-uint32_t FileClient::get_host() const {
-    return _socket.get_host();
-}
+void FileClient::_make_file_response(const http_request_t &request,
+                                     const file_meta_t &meta,
+                                     const cached_file_ptr &cached, int fd) {
+    bool with_body = request.method == GET_METHOD;
+
+    auto status = RangeStatus::none;
+    auto range = request.header("Range");
+    if (is_not_modified(request, meta)) {
+        _start(Status::not_modified);
+        add_validators(_response, meta);
+        _response.finish();
+        _push_head();
+    } else if (with_body && !range.empty() && meta.encoding == Encoding::identity
+               && range_applies(request, meta)
+               && (status = parse_ranges(range, meta.size, _ranges))
+                  != RangeStatus::none) {
+        if (status == RangeStatus::unsatisfiable) {
+            _start(Status::range_not_satisfiable);
+            _response.append("Content-Range: bytes */");
+            _response.append(meta.size);
+            _response.append(divider);
+            _response.header("Content-Length", 0);
+            _response.finish();
+            _push_head();
+        } else {
+            _push_ranges(meta, cached, fd);
+        }
+    } else if (cached) {
+        _start(Status::ok);
+        _push_head();
+        _push_cached(cached, with_body);
+    } else {
+        _start(Status::ok);
+        add_file_headers(_response, meta);
+        _push_head();
+        if (with_body) {
+            _connection.output().push(bstcp::FileRange(fd, 0, meta.size));
+            return;
+        }
+    }
 
-uint16_t FileClient::get_port() const {
-    return _socket.get_port();
+    if (fd != -1) {
+        close(fd);
+    }
 }
 
-bstcp::SocketStatus FileClient::get_status() const {
-    return _socket.get_status();
-}
+void FileClient::_push_ranges(const file_meta_t &meta, const cached_file_ptr &cached,
+                              int fd) {
+    if (_ranges.size() == 1) {
+        _start(Status::partial_content);
+        add_validators(_response, meta);
+        _response.header("Content-Type", meta.content_type);
+        add_content_range(_response, _ranges.front(), meta.size);
+        _response.header("Content-Length", _ranges.front().length);
+        _response.finish();
+        _push_head();
+        _push_body(cached, fd, _ranges.front());
+        return;
+    }
 
-bstcp::SocketStatus FileClient::disconnect() {
-    return _socket.disconnect();
+    // Heads of parts are made twice: to count the length and to send them
+    char boundary_buffer[boundary_size + 1];
+    auto boundary = make_boundary(boundary_buffer);
+    size_t length = 0;
+    for (const auto &range: _ranges) {
+        _response.clear();
+        add_part_head(_response, boundary, meta, range);
+        length += _response.size() + range.length;
+    }
+    _response.clear();
+    add_part_tail(_response, boundary);
+    length += _response.size();
+
+    _start(Status::partial_content);
+    add_validators(_response, meta);
+    _response.append("Content-Type: multipart/byteranges; boundary=");
+    _response.append(boundary);
+    _response.append(divider);
+    _response.header("Content-Length", length);
+    _response.finish();
+    _push_head();
+    for (const auto &range: _ranges) {
+        _response.clear();
+        add_part_head(_response, boundary, meta, range);
+        _push_head();
+        _push_body(cached, fd, range);
+    }
+    _response.clear();
+    add_part_tail(_response, boundary);
+    _push_head();
 }
 
-bool FileClient::recv_from(void *buffer, int size) {
-    return _socket.recv_from(buffer, size);
-}
+void FileClient::_push_body(const cached_file_ptr &cached, int fd,
+                            const byte_range_t &range) {
+    auto &output = _connection.output();
+    if (cached) {
+        output.push(cached->body.substr(range.offset, range.length),
+                    cached);
+        return;
+    }
 
-bool FileClient::send_to(const void *buffer, int size) const {
-    return _socket.send_to(buffer, size);
+    // Every part owns its descriptor and position
+    int part_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (part_fd == -1) {
+        // Response is cut short, so the connection can not be reused
+        _keep_alive = false;
+        return;
+    }
+    output.push(bstcp::FileRange(part_fd, (off_t)range.offset, range.length));
 }
 
-SocketType FileClient::get_type() const {
-    return SocketType::client_socket;
+void FileClient::_push_cached(cached_file_ptr file, bool with_body) {
+    auto &output = _connection.output();
+    output.push(file->headers, file);
+    if (with_body) {
+        output.push(file->body, file);
+    }
 }
 
-socket_t FileClient::get_socket() {
-    return _socket.get_socket();
+void FileClient::_make_metrics_response(const http_request_t &request) {
+    auto body = bstcp::Metrics::render();
+    _start(Status::ok);
+    _response.header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+    _response.header("Content-Length", body.size());
+    _response.finish();
+    _push_head();
+    if (request.method == GET_METHOD) {
+        _connection.output().push(std::move(body));
+    }
 }
 
-socket_addr_in FileClient::get_address() const {
-    return _socket.get_address();
-}
+void FileClient::_log_access(const http_request_t *request, size_t pushed_before,
+                             int64_t start) {
+    if (!AccessLog::is_enabled()) {
+        return;
+    }
 
-bool FileClient::is_allow_to_write(long timeout) const {
-    return _socket.is_allow_to_write(timeout);
+    access_entry_t entry;
+    entry.host = get_host();
+    entry.status = _status;
+    entry.bytes = _connection.output().get_pushed() - pushed_before;
+    entry.latency_us = (bstcp::Metrics::now() - start) / 1000;
+    if (request) {
+        entry.method = request->method;
+        entry.target = request->target;
+        entry.version_major = request->version_major;
+        entry.version_minor = request->version_minor;
+        entry.referer = request->header("Referer");
+        entry.user_agent = request->header("User-Agent");
+    }
+    AccessLog::add(entry);
 }
 
-bool FileClient::is_allow_to_rwrite(long timeout) const {
-    return _socket.is_allow_to_rwrite(timeout);
+bool FileClient::_process_input() {
+    auto &input = _connection.input();
+    auto &output = _connection.output();
+    while (_keep_alive && !output.is_full()) {
+        auto parse_start = bstcp::Metrics::now();
+        auto sts = _parser.parse(input.data());
+        if (sts == ParseStatus::need_more) {
+            return false;
+        }
+        bstcp::Metrics::record(bstcp::Histogram::parse_time,
+                               bstcp::Metrics::now() - parse_start);
+        bstcp::Metrics::add(bstcp::Counter::requests);
+
+        auto pushed = output.get_pushed();
+        if (sts == ParseStatus::error) {
+            _make_error_response(_parser.get_error());
+            _log_access(nullptr, pushed, parse_start);
+            input.consume(input.size());
+        } else {
+            _make_response(_parser.get_request());
+            _log_access(&_parser.get_request(), pushed, parse_start);
+            input.consume(_parser.get_request().size);
+        }
+        _parser.reset();
+        ++_requests_served;
+    }
+    return true;
 }
 
-bool FileClient::is_allow_to_read(long timeout) const {
-    return _socket.is_allow_to_read(timeout);
-}
+bstcp::Session FileClient::serve() {
+    while (true) {
+        // Requests received before the peer closed its side are still answered
+        bool open = co_await _connection.read();
+
+        // Responses to pipelined requests are queued in order of arrival
+        // and sent together
+        bool has_input = true;
+        while (has_input && _keep_alive) {
+            has_input = _process_input();
+            if (!co_await _connection.flush()) {
+                co_return;
+            }
+        }
 
-status FileClient::accept(const std::unique_ptr<ISocket> &server_socket) {
-    return _socket.accept(server_socket);
+        if (!open) {
+            co_return;
+        }
+        if (!_keep_alive) {
+            // Unread requests or a body left in the socket would reset
+            // the connection on close and could destroy the response
+            co_await _connection.linger();
+            co_return;
+        }
+    }
 }
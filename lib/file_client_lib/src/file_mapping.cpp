@@ -0,0 +1,127 @@
+#include "file_mapping.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+namespace file {
+
+static const size_t huge_page_size = 2 * 1024 * 1024;
+static const size_t cache_line_size = 64;
+// Larger files would leave too much of a block unused
+static const size_t block_parts_count = 32;
+
+FileMapping::FileMapping(void *address, size_t size)
+        : _address(address)
+        , _size(size) {}
+
+FileMapping::~FileMapping() {
+    munmap(_address, _size);
+}
+
+std::shared_ptr<const FileMapping> FileMapping::map(int fd, size_t size) {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    auto *address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        return nullptr;
+    }
+    // Files are sent from start to end, so all of it is read ahead
+    madvise(address, size, MADV_SEQUENTIAL);
+    madvise(address, size, MADV_WILLNEED);
+    return std::shared_ptr<const FileMapping>(new FileMapping(address, size));
+}
+
+std::string_view FileMapping::data() const {
+    return {(const char *)_address, _size};
+}
+
+FileArena::Block::Block(char *address, size_t size)
+        : address(address)
+        , size(size) {}
+
+FileArena::Block::~Block() {
+    munmap(address, size);
+}
+
+FileArena::FileArena(size_t block_size)
+        : _block_size((block_size + huge_page_size - 1) / huge_page_size * huge_page_size) {}
+
+size_t FileArena::get_max_file_size() const {
+    return _block_size / block_parts_count;
+}
+
+std::shared_ptr<FileArena::Block> FileArena::_make_block() const {
+    auto *address = mmap(nullptr, _block_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (address != MAP_FAILED) {
+        return std::make_shared<Block>((char *)address, _block_size);
+    }
+
+    // No reserved huge pages. Aligned block may still get transparent ones
+    auto size = _block_size + huge_page_size;
+    address = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (address == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto start = (uintptr_t)address;
+    auto aligned = (start + huge_page_size - 1) & ~(uintptr_t)(huge_page_size - 1);
+    if (aligned > start) {
+        munmap(address, aligned - start);
+    }
+    auto end = aligned + _block_size;
+    if (start + size > end) {
+        munmap((void *)end, start + size - end);
+    }
+    madvise((void *)aligned, _block_size, MADV_HUGEPAGE);
+    return std::make_shared<Block>((char *)aligned, _block_size);
+}
+
+bool FileArena::load(int fd, size_t size, std::string_view &body,
+                     std::shared_ptr<const void> &owner) {
+    if (size > get_max_file_size()) {
+        return false;
+    }
+
+    std::shared_ptr<Block> block;
+    char *place;
+    {
+        std::lock_guard lock(_mutex);
+        if (!_current || _current->size - _current->used < size) {
+            // Previous block lives while its files are used
+            _current = _make_block();
+            if (!_current) {
+                return false;
+            }
+        }
+        block = _current;
+        place = block->address + block->used;
+        block->used = std::min(block->size, block->used
+                               + (size + cache_line_size - 1) / cache_line_size
+                                 * cache_line_size);
+    }
+
+    // Each file has own place, so it is copied without the lock
+    size_t done = 0;
+    while (done < size) {
+        auto got = pread(fd, place + done, size - done, (off_t)done);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        done += got;
+    }
+
+    body = {place, size};
+    owner = std::move(block);
+    return true;
+}
+
+}
@@ -1,63 +1,436 @@
 #include "file_system.hpp"
 
+#include <linux/openat2.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include "http_date.hpp"
+#include "mime_types.hpp"
+
 namespace file {
 
-std::size_t replace_all(std::string& inout, std::string_view what, std::string_view with) {
-    std::size_t count{};
-    for (std::string::size_type pos{};
-         std::string::npos != (pos = inout.find(what.data(), pos, what.length()));
-         pos += with.length(), ++count) {
-        inout.replace(pos, what.length(), with.data(), with.length());
-    }
-    return count;
-}
-
-std::string Filesystem::encode_file_type(const std::string &extension) {
-    if (extension == ".txt")
-        return "text/txt";
-    else if (extension == ".css")
-        return "text/css";
-    else if (extension == ".html")
-        return "text/html";
-    else if (extension == ".js")
-        return "application/javascript";
-    else if (extension == ".jpeg" || extension == ".jpg")
-        return "image/jpeg";
-    else if (extension == ".png")
-        return "image/png";
-    else if (extension == ".gif")
-        return "image/gif";
-    else if (extension == ".swf")
-        return "application/x-shockwave-flash";
-    return "";
-}
-
-requested_file_t Filesystem::get_file(const std::string& path_) const {
-    auto path = path_;
-    replace_all(path, "../", "");
-    fs::path cur_path = _root_dir.string() + "/" + path;
-    if (!fs::exists(cur_path)) {
-        return requested_file_t{"", file_status::not_found};
-    }
-
-    if (is_directory(cur_path)) {
-        bool allowed_file = false;
-        for (const auto &file: fs::directory_iterator{cur_path}) {
-            if (!file.is_directory() && fs::path(file).filename() == "index.html") {
-                allowed_file = true;
+static const size_t default_cache_size = 64 * 1024 * 1024;
+static const size_t default_max_cached_file_size = 1024 * 1024;
+static const size_t max_missing_paths = 16 * 1024;
+static const size_t arena_block_size = 2 * 1024 * 1024;
+
+static std::atomic<BodySource> body_source = BodySource::read;
+
+static const char *index_file = "index.html";
+
+static const uint32_t watched_events = IN_CREATE | IN_DELETE | IN_MODIFY
+                                       | IN_CLOSE_WRITE | IN_ATTRIB
+                                       | IN_MOVED_FROM | IN_MOVED_TO
+                                       | IN_DELETE_SELF | IN_MOVE_SELF;
+
+// Events of one copy or save are applied by a single rebuild
+static const int settle_time_ms = 100;
+static const int max_settle_rounds = 10;
+
+// Manifests of all instances are numbered together, so a pointer cached
+// by a thread for one instance is never taken for another
+static uint64_t next_generation() {
+    static std::atomic<uint64_t> generation = 0;
+    return ++generation;
+}
+
+std::string_view Filesystem::encode_file_type(std::string_view extension) {
+    if (extension.empty() || extension.front() != '.') {
+        return {};
+    }
+    return mime_table.find(extension.substr(1));
+}
+
+file_meta_t Filesystem::get_meta(const fs::path &path, const struct stat &info) {
+    file_meta_t meta;
+    meta.content_type = encode_file_type(path.extension().native());
+    meta.mtime = info.st_mtim.tv_sec;
+    meta.size = info.st_size;
+    meta.last_modified = format_http_date(meta.mtime);
+    meta.vary = is_compressible(meta.content_type);
+
+    // Changes with every write of the file, as in other servers
+    char etag[40];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)meta.mtime,
+             (unsigned long)meta.size);
+    meta.etag = etag;
+    return meta;
+}
+
+PathStatus Filesystem::normalize(std::string &path) {
+    if (path.find('\0') != std::string::npos) {
+        return PathStatus::invalid;
+    }
+
+    bool trailing_slash = !path.empty() && path.back() == '/';
+
+    // Output never outruns input, so segments are moved in place
+    size_t size = 0;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        auto end = path.find('/', pos);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        std::string_view segment(path.data() + pos, end - pos);
+
+        if (segment == "..") {
+            if (size == 0) {
+                return PathStatus::above_root;
+            }
+            auto slash = path.rfind('/', size - 1);
+            size = slash == std::string::npos ? 0 : slash;
+        } else if (!segment.empty() && segment != ".") {
+            if (size > 0) {
+                path[size++] = '/';
+            }
+            std::memmove(path.data() + size, segment.data(), segment.size());
+            size += segment.size();
+        }
+        pos = end + 1;
+    }
+
+    path.resize(size);
+    if (trailing_slash && size > 0) {
+        path += '/';
+    }
+    return PathStatus::ok;
+}
+
+Filesystem::Filesystem(const std::string &root_dir)
+    : _root_dir(fs::absolute(root_dir))
+    , _root_fd(open(_root_dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC))
+    , _cache(default_cache_size, default_max_cached_file_size)
+    , _misses(max_missing_paths) {}
+
+Filesystem::~Filesystem() {
+    if (_watcher.joinable()) {
+        uint64_t wake = 1;
+        auto written = write(_wake_fd, &wake, sizeof(wake));
+        (void)written;
+        _watcher.join();
+    }
+    if (_wake_fd != -1) {
+        close(_wake_fd);
+    }
+    if (_root_fd != -1) {
+        close(_root_fd);
+    }
+}
+
+Filesystem &Filesystem::current() {
+    static Filesystem files(fs::current_path());
+    return files;
+}
+
+FileArena &Filesystem::_arena() {
+    static FileArena arena(arena_block_size);
+    return arena;
+}
+
+int open_beneath(int dir_fd, const char *path, int flags) {
+    static std::atomic<bool> has_openat2 = true;
+
+    flags |= O_RDONLY | O_CLOEXEC;
+    if (has_openat2.load(std::memory_order_relaxed)) {
+        struct open_how how{};
+        how.flags = flags;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+
+        int fd;
+        do {
+            // Retried if a rename raced with the lookup
+            fd = (int)syscall(SYS_openat2, dir_fd, path, &how, sizeof(how));
+        } while (fd == -1 && errno == EAGAIN);
+
+        if (fd != -1 || errno != ENOSYS) {
+            return fd;
+        }
+        has_openat2.store(false, std::memory_order_relaxed);
+    }
+
+    // Old kernels: dot segments are applied by normalize,
+    // only symbolic links may still lead outside of the root
+    return openat(dir_fd, path, flags);
+}
+
+static void add_watches(int notify_fd, const fs::path &root, const Manifest &manifest) {
+    for (const auto &dir: manifest.get_directories()) {
+        auto path = dir.empty() ? root.native() : root.native() + "/" + dir;
+        inotify_add_watch(notify_fd, path.c_str(), watched_events | IN_ONLYDIR);
+    }
+}
+
+// True if something was read
+static bool drain(int fd) {
+    alignas(inotify_event) char buffer[4096];
+    bool any = false;
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+        any = true;
+    }
+    return any;
+}
+
+bool Filesystem::enable_manifest() {
+    if (_watcher.joinable()) {
+        return true;
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    auto manifest = Manifest::build(_root_dir, _root_fd);
+    if (!manifest) {
+        return false;
+    }
+
+    // Watcher goes on without the sources that could not be made
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    int notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd != -1) {
+        add_watches(notify_fd, _root_dir, *manifest);
+    }
+    _wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    {
+        std::lock_guard lock(_manifest_mutex);
+        _manifest = std::move(manifest);
+        _generation.store(next_generation(), std::memory_order_release);
+    }
+    _watcher = std::thread(&Filesystem::_watch, this, signal_fd, notify_fd);
+    return true;
+}
+
+const manifest_ptr &Filesystem::get_manifest() const {
+    struct local_t {
+        uint64_t        generation = 0;
+        manifest_ptr    manifest;
+    };
+    thread_local local_t local;
+
+    auto generation = _generation.load(std::memory_order_acquire);
+    if (generation != local.generation) {
+        std::lock_guard lock(_manifest_mutex);
+        local.manifest = _manifest;
+        local.generation = _generation.load(std::memory_order_relaxed);
+    }
+    return local.manifest;
+}
+
+void Filesystem::_watch(int signal_fd, int notify_fd) {
+    pollfd fds[] = {{_wake_fd, POLLIN, 0}, {signal_fd, POLLIN, 0}, {notify_fd, POLLIN, 0}};
+
+    while (true) {
+        if (poll(fds, std::size(fds), -1) <= 0) {
+            continue;
+        }
+        if (fds[0].revents != 0) {
+            break;
+        }
+
+        bool signaled = drain(signal_fd);
+        if (!drain(notify_fd) && !signaled) {
+            continue;
+        }
+        for (int i = 0; i < max_settle_rounds; ++i) {
+            if (poll(&fds[2], 1, settle_time_ms) <= 0 || !drain(notify_fd)) {
                 break;
             }
         }
 
-        if (!allowed_file) {
-            return requested_file_t{"", file_status::forbidden};
+        // Old manifest is kept if the root could not be scanned
+        auto manifest = Manifest::build(_root_dir, _root_fd);
+        if (!manifest) {
+            continue;
+        }
+        if (notify_fd != -1) {
+            add_watches(notify_fd, _root_dir, *manifest);
         }
-        return requested_file_t{cur_path.string()  + "/index.html", file_status::correct};
+        {
+            std::lock_guard lock(_manifest_mutex);
+            _manifest.swap(manifest);
+            _generation.store(next_generation(), std::memory_order_release);
+        }
+        // Previous manifest closes its files outside of the lock
+        manifest.reset();
+        _cache.clear();
+    }
+
+    if (signal_fd != -1) {
+        close(signal_fd);
+    }
+    if (notify_fd != -1) {
+        close(notify_fd);
     }
-    return requested_file_t{cur_path, file_status::correct};
 }
 
-Filesystem::Filesystem(const std::string &root_dir)
-    : _root_dir(root_dir) {}
+int Filesystem::open_file(const std::string &path, struct stat &info) const {
+    if (const auto &manifest = get_manifest()) {
+        bool exists;
+        auto *entry = manifest->find(path, exists);
+        if (!entry) {
+            return -1;
+        }
+        info = entry->info;
+        return fcntl(entry->fd, F_DUPFD_CLOEXEC, 0);
+    }
+
+    int fd = open_beneath(_root_fd, path.c_str());
+    if (fd == -1) {
+        return -1;
+    }
 
-}
\ No newline at end of file
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+requested_file_t Filesystem::_get_indexed(const Manifest &manifest,
+                                          const std::string &path) const {
+    requested_file_t res;
+    res.status = file_status::not_found;
+
+    bool exists;
+    auto *entry = manifest.find(path, exists);
+    if (!entry) {
+        if (exists) {
+            res.status = file_status::forbidden;
+        }
+        return res;
+    }
+
+    res.fd = fcntl(entry->fd, F_DUPFD_CLOEXEC, 0);
+    if (res.fd == -1) {
+        return res;
+    }
+    res.path = entry->path;
+    res.relative = entry->relative;
+    res.info = entry->info;
+    res.meta = entry->meta;
+    res.status = file_status::correct;
+    return res;
+}
+
+requested_file_t Filesystem::get_file(const std::string& path) const {
+    if (const auto &manifest = get_manifest()) {
+        return _get_indexed(*manifest, path);
+    }
+
+    requested_file_t res;
+    res.status = file_status::not_found;
+    if (_misses.contains(path)) {
+        return res;
+    }
+
+    int fd = open_beneath(_root_fd, path.empty() ? "." : path.c_str());
+    if (fd == -1) {
+        if (errno == ENOENT || errno == ENOTDIR) {
+            _misses.put(path);
+        }
+        return res;
+    }
+    if (fstat(fd, &res.info) == -1) {
+        close(fd);
+        return res;
+    }
+
+    res.relative = path;
+    if (S_ISDIR(res.info.st_mode)) {
+        // Directory is served only by its index
+        int index_fd = open_beneath(fd, index_file);
+        close(fd);
+        fd = index_fd;
+
+        res.status = file_status::forbidden;
+        if (fd == -1) {
+            return res;
+        }
+        if (fstat(fd, &res.info) == -1) {
+            close(fd);
+            return res;
+        }
+        if (!res.relative.empty() && res.relative.back() != '/') {
+            res.relative += '/';
+        }
+        res.relative += index_file;
+    }
+
+    if (!S_ISREG(res.info.st_mode)) {
+        close(fd);
+        return res;
+    }
+
+    res.path = _root_dir.native() + "/" + res.relative;
+    res.meta = get_meta(res.path, res.info);
+    res.status = file_status::correct;
+    res.fd = fd;
+    return res;
+}
+
+cached_file_ptr Filesystem::get_cached(std::string_view path,
+                                       Encoding encoding) const {
+    return _cache.get(path, encoding);
+}
+
+void Filesystem::put_cached(std::string_view path, cached_file_ptr file,
+                            Encoding encoding) const {
+    _cache.put(path, encoding, std::move(file));
+}
+
+size_t Filesystem::get_max_cached_file_size() const {
+    return _cache.get_max_file_size();
+}
+
+void Filesystem::set_cache_limits(size_t max_size, size_t max_file_size) {
+    _cache.set_limits(max_size, max_file_size);
+}
+
+void Filesystem::set_body_source(BodySource source) {
+    body_source.store(source, std::memory_order_relaxed);
+}
+
+bool Filesystem::load_body(int fd, size_t size, cached_file_t &file) {
+    if (body_source.load(std::memory_order_relaxed) == BodySource::mmap) {
+        if (size <= _arena().get_max_file_size()) {
+            return _arena().load(fd, size, file.body, file.storage);
+        }
+        // Files compressed by the server are read in user space
+        if (!file.meta.vary) {
+            if (auto mapping = FileMapping::map(fd, size)) {
+                file.body = mapping->data();
+                file.storage = std::move(mapping);
+                return true;
+            }
+        }
+    }
+
+    file.buffer.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        auto got = pread(fd, file.buffer.data() + done, size - done, (off_t)done);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        done += got;
+    }
+    file.body = file.buffer;
+    return true;
+}
+
+}
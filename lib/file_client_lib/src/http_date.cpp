@@ -0,0 +1,112 @@
+#include "http_date.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace file {
+
+static const char *formats[] = {
+        "%a, %d %b %Y %H:%M:%S GMT",
+        "%A, %d-%b-%y %H:%M:%S GMT",
+        "%a %b %e %H:%M:%S %Y"
+};
+
+static const size_t max_date_size = 64;
+
+std::string format_http_date(std::time_t time) {
+    struct tm tm{};
+    gmtime_r(&time, &tm);
+
+    std::array<char, max_date_size> buffer{};
+    auto size = strftime(buffer.data(), buffer.size(), formats[0], &tm);
+    return {buffer.data(), size};
+}
+
+namespace {
+
+// Date kept in atomic words under a sequence lock: a reader retries if
+// the sequence was odd or changed while it copied the words
+class DateClock {
+  public:
+    DateClock() {
+        _refresh();
+        std::thread([this] { _run(); }).detach();
+    }
+
+    void copy(char *out) const {
+        std::array<uint64_t, words_count> words{};
+        uint64_t before;
+        uint64_t after;
+        do {
+            before = _sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < words_count; ++i) {
+                words[i] = _words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = _sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) != 0 || before != after);
+        memcpy(out, words.data(), http_date_size);
+    }
+
+  private:
+    static constexpr size_t words_count = (http_date_size + 7) / 8;
+
+    [[noreturn]] void _run() {
+        using namespace std::chrono;
+        while (true) {
+            auto next = time_point_cast<seconds>(system_clock::now()) + seconds(1);
+            std::this_thread::sleep_until(next);
+            _refresh();
+        }
+    }
+
+    void _refresh() {
+        // time() may read a coarse clock still behind the second boundary
+        auto now = std::chrono::system_clock::now();
+        auto date = format_http_date(std::chrono::system_clock::to_time_t(now));
+        std::array<uint64_t, words_count> words{};
+        memcpy(words.data(), date.data(), std::min(date.size(), http_date_size));
+
+        auto sequence = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < words_count; ++i) {
+            _words[i].store(words[i], std::memory_order_relaxed);
+        }
+        _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    std::atomic<uint64_t>                           _sequence{0};
+    std::array<std::atomic<uint64_t>, words_count>  _words{};
+};
+
+}
+
+void get_current_http_date(char *out) {
+    // Never destroyed, as its thread runs until the process exits
+    static auto *clock = new DateClock();
+    clock->copy(out);
+}
+
+bool parse_http_date(std::string_view value, std::time_t &time) {
+    if (value.empty() || value.size() >= max_date_size) {
+        return false;
+    }
+    // strptime needs terminated string
+    std::string date(value);
+
+    for (const auto *format: formats) {
+        struct tm tm{};
+        const char *end = strptime(date.c_str(), format, &tm);
+        if (end != nullptr && *end == '\0') {
+            time = timegm(&tm);
+            return true;
+        }
+    }
+    return false;
+}
+
+}
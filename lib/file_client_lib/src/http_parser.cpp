@@ -0,0 +1,255 @@
+#include "http_parser.hpp"
+
+namespace file {
+
+static const uint16_t STATUS_BAD_REQUEST = 400;
+static const uint16_t STATUS_URI_TOO_LONG = 414;
+static const uint16_t STATUS_HEADERS_TOO_LARGE = 431;
+static const uint16_t STATUS_VERSION_NOT_SUPPORTED = 505;
+
+static bool is_token_char(char ch) {
+    if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')
+        || (ch >= '0' && ch <= '9')) {
+        return true;
+    }
+    switch (ch) {
+        case '!': case '#': case '$': case '%': case '&': case '\'':
+        case '*': case '+': case '-': case '.': case '^': case '_':
+        case '`': case '|': case '~':
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool is_ctl(char ch) {
+    return (unsigned char)ch < 0x20 || ch == 0x7f;
+}
+
+static char to_lower(char ch) {
+    return (ch >= 'A' && ch <= 'Z') ? (char)(ch - 'A' + 'a') : ch;
+}
+
+std::string_view http_request_t::header(std::string_view name) const {
+    for (size_t i = 0; i < headers_count; ++i) {
+        auto &cur = headers[i].name;
+        if (cur.size() != name.size()) {
+            continue;
+        }
+
+        size_t j = 0;
+        while (j < name.size() && to_lower(cur[j]) == to_lower(name[j])) {
+            ++j;
+        }
+        if (j == name.size()) {
+            return headers[i].value;
+        }
+    }
+    return {};
+}
+
+ParseStatus HttpParser::_error(uint16_t code) {
+    _error_code = code;
+    return ParseStatus::error;
+}
+
+uint16_t HttpParser::_finish_request_line(std::string_view data) {
+    auto version = data.substr(_version.begin, _version.end - _version.begin);
+    if (version.size() != 8 || version.substr(0, 5) != "HTTP/"
+        || version[5] < '0' || version[5] > '9' || version[6] != '.'
+        || version[7] < '0' || version[7] > '9') {
+        return STATUS_BAD_REQUEST;
+    }
+
+    _request.version_major = version[5] - '0';
+    _request.version_minor = version[7] - '0';
+    if (_request.version_major != 1) {
+        return STATUS_VERSION_NOT_SUPPORTED;
+    }
+    return 0;
+}
+
+ParseStatus HttpParser::parse(std::string_view data) {
+    if (_error_code != 0) {
+        return ParseStatus::error;
+    }
+
+    for (; _pos < data.size(); ++_pos) {
+        char ch = data[_pos];
+
+        if (_state >= state_t::header_start && _pos >= max_request_head_size) {
+            return _error(STATUS_HEADERS_TOO_LARGE);
+        }
+
+        switch (_state) {
+            case state_t::start:
+                // Empty lines before request line are allowed
+                if (ch == '\r' || ch == '\n') {
+                    continue;
+                }
+                if (!is_token_char(ch)) {
+                    return _error(STATUS_BAD_REQUEST);
+                }
+                _method.begin = _pos;
+                _state = state_t::method;
+                break;
+
+            case state_t::method:
+                if (ch == ' ') {
+                    _method.end = _pos;
+                    _target.begin = _pos + 1;
+                    _state = state_t::target;
+                } else if (!is_token_char(ch)) {
+                    return _error(STATUS_BAD_REQUEST);
+                }
+                break;
+
+            case state_t::target:
+                if (ch == ' ') {
+                    _target.end = _pos;
+                    if (_target.end == _target.begin) {
+                        return _error(STATUS_BAD_REQUEST);
+                    }
+                    _version.begin = _pos + 1;
+                    _state = state_t::version;
+                } else if (is_ctl(ch)) {
+                    return _error(STATUS_BAD_REQUEST);
+                } else if (_pos - _method.begin >= max_request_line_size) {
+                    return _error(STATUS_URI_TOO_LONG);
+                }
+                break;
+
+            case state_t::version:
+                if (ch == '\r' || ch == '\n') {
+                    _version.end = _pos;
+                    if (auto code = _finish_request_line(data); code != 0) {
+                        return _error(code);
+                    }
+                    _state = ch == '\r' ? state_t::line_lf : state_t::header_start;
+                } else if (_pos - _version.begin > 8) {
+                    return _error(STATUS_BAD_REQUEST);
+                }
+                break;
+
+            case state_t::line_lf:
+                if (ch != '\n') {
+                    return _error(STATUS_BAD_REQUEST);
+                }
+                _state = state_t::header_start;
+                break;
+
+            case state_t::header_start:
+                if (ch == '\r') {
+                    _state = state_t::head_lf;
+                } else if (ch == '\n') {
+                    ++_pos;
+                    _fill_request(data);
+                    return ParseStatus::complete;
+                } else if (is_token_char(ch)) {
+                    _header.name.begin = _pos;
+                    _state = state_t::header_name;
+                } else {
+                    // Obsolete line folding is rejected as well
+                    return _error(STATUS_BAD_REQUEST);
+                }
+                break;
+
+            case state_t::header_name:
+                if (ch == ':') {
+                    _header.name.end = _pos;
+                    _state = state_t::header_value_start;
+                } else if (!is_token_char(ch)) {
+                    return _error(STATUS_BAD_REQUEST);
+                }
+                break;
+
+            case state_t::header_value_start:
+                if (ch == ' ' || ch == '\t') {
+                    break;
+                }
+                _header.value.begin = _pos;
+                _state = state_t::header_value;
+                [[fallthrough]];
+
+            case state_t::header_value:
+                if (ch == '\r' || ch == '\n') {
+                    _header.value.end = _pos;
+                    while (_header.value.end > _header.value.begin
+                           && (data[_header.value.end - 1] == ' '
+                               || data[_header.value.end - 1] == '\t')) {
+                        --_header.value.end;
+                    }
+
+                    if (_headers_count == max_headers_count) {
+                        return _error(STATUS_HEADERS_TOO_LARGE);
+                    }
+                    _headers[_headers_count++] = _header;
+                    _state = ch == '\r' ? state_t::header_lf : state_t::header_start;
+                } else if (is_ctl(ch) && ch != '\t') {
+                    return _error(STATUS_BAD_REQUEST);
+                }
+                break;
+
+            case state_t::header_lf:
+                if (ch != '\n') {
+                    return _error(STATUS_BAD_REQUEST);
+                }
+                _state = state_t::header_start;
+                break;
+
+            case state_t::head_lf:
+                if (ch != '\n') {
+                    return _error(STATUS_BAD_REQUEST);
+                }
+                ++_pos;
+                _fill_request(data);
+                return ParseStatus::complete;
+        }
+    }
+
+    if (_state <= state_t::version && _pos > max_request_line_size) {
+        return _error(_state == state_t::target ? STATUS_URI_TOO_LONG
+                                                : STATUS_BAD_REQUEST);
+    }
+    return ParseStatus::need_more;
+}
+
+void HttpParser::_fill_request(std::string_view data) {
+    auto view = [&data](span_t span) {
+        return data.substr(span.begin, span.end - span.begin);
+    };
+
+    _request.method = view(_method);
+    _request.target = view(_target);
+
+    auto query_pos = _request.target.find('?');
+    _request.path = _request.target.substr(0, query_pos);
+    _request.query = query_pos == std::string_view::npos
+                     ? std::string_view()
+                     : _request.target.substr(query_pos + 1);
+
+    _request.headers_count = _headers_count;
+    for (size_t i = 0; i < _headers_count; ++i) {
+        _request.headers[i] = {view(_headers[i].name), view(_headers[i].value)};
+    }
+    _request.size = _pos;
+}
+
+const http_request_t &HttpParser::get_request() const {
+    return _request;
+}
+
+uint16_t HttpParser::get_error() const {
+    return _error_code;
+}
+
+void HttpParser::reset() {
+    _state = state_t::start;
+    _pos = 0;
+    _error_code = 0;
+    _headers_count = 0;
+    _request.headers_count = 0;
+    _request.size = 0;
+}
+
+}
@@ -0,0 +1,124 @@
+#include "http_range.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+namespace file {
+
+static std::string_view trim(std::string_view value) {
+    auto first = value.find_first_not_of(" \t");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    return value.substr(first, value.find_last_not_of(" \t") - first + 1);
+}
+
+static bool parse_number(std::string_view value, size_t &number) {
+    if (value.empty()) {
+        return false;
+    }
+    auto res = std::from_chars(value.data(), value.data() + value.size(), number);
+    return res.ec == std::errc() && res.ptr == value.data() + value.size();
+}
+
+// False if the spec is malformed, satisfiable is false if it is valid
+// but selects nothing of the file
+static bool parse_spec(std::string_view spec, size_t size,
+                       byte_range_t &range, bool &satisfiable) {
+    auto dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+        return false;
+    }
+    auto first_str = trim(spec.substr(0, dash));
+    auto last_str = trim(spec.substr(dash + 1));
+
+    if (first_str.empty()) {
+        // Suffix of the given length
+        size_t suffix;
+        if (!parse_number(last_str, suffix)) {
+            return false;
+        }
+        satisfiable = suffix > 0 && size > 0;
+        range.length = std::min(suffix, size);
+        range.offset = size - range.length;
+        return true;
+    }
+
+    size_t first;
+    size_t last = size == 0 ? 0 : size - 1;
+    if (!parse_number(first_str, first)) {
+        return false;
+    }
+    if (!last_str.empty()) {
+        if (!parse_number(last_str, last) || last < first) {
+            return false;
+        }
+    }
+
+    satisfiable = first < size;
+    if (satisfiable) {
+        last = std::min(last, size - 1);
+        range.offset = first;
+        range.length = last - first + 1;
+    }
+    return true;
+}
+
+RangeStatus parse_ranges(std::string_view value, size_t size,
+                         std::vector<byte_range_t> &ranges) {
+    ranges.clear();
+
+    value = trim(value);
+    auto eq = value.find('=');
+    if (eq == std::string_view::npos) {
+        return RangeStatus::none;
+    }
+    auto unit = trim(value.substr(0, eq));
+    if (unit.size() != 5
+        || !std::equal(unit.begin(), unit.end(), "bytes",
+                       [](char a, char b) { return tolower(a) == b; })) {
+        return RangeStatus::none;
+    }
+
+    size_t specs = 0;
+    size_t total = 0;
+    auto list = value.substr(eq + 1);
+    while (!list.empty()) {
+        auto end = list.find(',');
+        auto spec = trim(list.substr(0, end));
+        list = end == std::string_view::npos ? "" : list.substr(end + 1);
+        if (spec.empty()) {
+            continue;
+        }
+
+        if (++specs > max_ranges_count) {
+            return RangeStatus::none;
+        }
+
+        byte_range_t range;
+        bool satisfiable = false;
+        if (!parse_spec(spec, size, range, satisfiable)) {
+            return RangeStatus::none;
+        }
+        if (satisfiable) {
+            ranges.push_back(range);
+            total += range.length;
+        }
+    }
+
+    if (specs == 0) {
+        return RangeStatus::none;
+    }
+    if (ranges.empty()) {
+        return RangeStatus::unsatisfiable;
+    }
+    // Overlapping ranges would make the response larger than the file
+    if (total > size) {
+        ranges.clear();
+        return RangeStatus::none;
+    }
+    return RangeStatus::satisfiable;
+}
+
+}
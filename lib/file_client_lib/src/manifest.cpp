@@ -0,0 +1,285 @@
+#include "manifest.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "file_system.hpp"
+
+namespace file {
+
+static const size_t max_scan_threads = 8;
+static const size_t min_slots_count = 16;
+
+static const char *index_file = "index.html";
+
+namespace {
+
+struct scanned_dir_t {
+    std::string relative;
+    int         fd;
+};
+
+struct scan_result_t {
+    std::vector<manifest_entry_t>                       files;
+    // Directory and its index file, empty if there is none
+    std::vector<std::pair<std::string, std::string>>    directories;
+};
+
+struct scan_queue_t {
+    std::mutex                  mutex;
+    std::condition_variable     wait;
+    std::deque<scanned_dir_t>   dirs;
+    // Queued directories and ones being scanned
+    size_t                      pending = 0;
+    std::atomic<bool>           failed = false;
+};
+
+}
+
+static bool is_resource_error(int error) {
+    return error == EMFILE || error == ENFILE || error == ENOMEM;
+}
+
+static unsigned char entry_type(int dir_fd, const dirent &entry) {
+    if (entry.d_type != DT_UNKNOWN) {
+        return entry.d_type;
+    }
+
+    struct stat info{};
+    if (fstatat(dir_fd, entry.d_name, &info, AT_SYMLINK_NOFOLLOW) == -1) {
+        return DT_UNKNOWN;
+    }
+    if (S_ISDIR(info.st_mode)) {
+        return DT_DIR;
+    }
+    if (S_ISREG(info.st_mode)) {
+        return DT_REG;
+    }
+    return S_ISLNK(info.st_mode) ? DT_LNK : DT_UNKNOWN;
+}
+
+// Opened regular file, -1 if the entry is not served
+static int open_regular(int root_fd, int dir_fd, const dirent &entry,
+                        unsigned char type, const std::string &relative,
+                        struct stat &info, std::atomic<bool> &failed) {
+    // Links are resolved from the root as requests would be
+    int fd = type == DT_REG
+             ? openat(dir_fd, entry.d_name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW)
+             : open_beneath(root_fd, relative.c_str());
+    if (fd == -1) {
+        if (is_resource_error(errno)) {
+            failed = true;
+        }
+        return -1;
+    }
+
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void scan_directory(const fs::path &root, int root_fd, scanned_dir_t dir,
+                           scan_result_t &result, std::vector<scanned_dir_t> &subdirs,
+                           std::atomic<bool> &failed) {
+    DIR *stream = fdopendir(dir.fd);
+    if (!stream) {
+        close(dir.fd);
+        failed = true;
+        return;
+    }
+
+    std::string index;
+    while (auto *entry = readdir(stream)) {
+        std::string_view name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+
+        auto relative = dir.relative.empty()
+                        ? std::string(name) : dir.relative + "/" + entry->d_name;
+        auto type = entry_type(dirfd(stream), *entry);
+        if (type == DT_DIR) {
+            int fd = openat(dirfd(stream), entry->d_name,
+                            O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+            if (fd != -1) {
+                subdirs.push_back({std::move(relative), fd});
+            } else if (is_resource_error(errno)) {
+                failed = true;
+            }
+            continue;
+        }
+        if (type != DT_REG && type != DT_LNK) {
+            continue;
+        }
+
+        manifest_entry_t file;
+        file.fd = open_regular(root_fd, dirfd(stream), *entry, type, relative,
+                               file.info, failed);
+        if (file.fd == -1) {
+            continue;
+        }
+        if (name == index_file) {
+            index = relative;
+        }
+        file.path = root.native() + "/" + relative;
+        file.meta = Filesystem::get_meta(file.path, file.info);
+        file.relative = std::move(relative);
+        result.files.push_back(std::move(file));
+    }
+    closedir(stream);
+
+    result.directories.emplace_back(std::move(dir.relative), std::move(index));
+}
+
+static void scan_worker(const fs::path &root, int root_fd, scan_queue_t &queue,
+                        scan_result_t &result) {
+    std::vector<scanned_dir_t> subdirs;
+
+    std::unique_lock lock(queue.mutex);
+    while (true) {
+        queue.wait.wait(lock, [&queue] {
+            return !queue.dirs.empty() || queue.pending == 0;
+        });
+        if (queue.dirs.empty()) {
+            return;
+        }
+        auto dir = std::move(queue.dirs.front());
+        queue.dirs.pop_front();
+        lock.unlock();
+
+        if (queue.failed) {
+            // Remaining directories are only closed
+            close(dir.fd);
+        } else {
+            scan_directory(root, root_fd, std::move(dir), result, subdirs, queue.failed);
+        }
+
+        lock.lock();
+        queue.pending += subdirs.size();
+        --queue.pending;
+        for (auto &subdir: subdirs) {
+            queue.dirs.push_back(std::move(subdir));
+        }
+        subdirs.clear();
+        queue.wait.notify_all();
+    }
+}
+
+Manifest::~Manifest() {
+    for (const auto &entry: _entries) {
+        close(entry.fd);
+    }
+}
+
+manifest_ptr Manifest::build(const fs::path &root, int root_fd) {
+    int root_dir_fd = open_beneath(root_fd, ".", O_DIRECTORY);
+    if (root_dir_fd == -1) {
+        return nullptr;
+    }
+
+    scan_queue_t queue;
+    queue.dirs.push_back({"", root_dir_fd});
+    queue.pending = 1;
+
+    auto threads_count = std::clamp<size_t>(std::thread::hardware_concurrency(),
+                                            1, max_scan_threads);
+    std::vector<scan_result_t> results(threads_count);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threads_count; ++i) {
+        threads.emplace_back(scan_worker, std::cref(root), root_fd,
+                             std::ref(queue), std::ref(results[i]));
+    }
+    scan_worker(root, root_fd, queue, results[0]);
+    for (auto &thread: threads) {
+        thread.join();
+    }
+
+    // Owns opened files from here, so they are closed on failure too
+    auto manifest = std::make_shared<Manifest>();
+    for (auto &result: results) {
+        std::move(result.files.begin(), result.files.end(),
+                  std::back_inserter(manifest->_entries));
+    }
+    if (queue.failed) {
+        return nullptr;
+    }
+
+    std::unordered_map<std::string_view, uint32_t> files;
+    for (uint32_t i = 0; i < manifest->_entries.size(); ++i) {
+        const auto &relative = manifest->_entries[i].relative;
+        files.emplace(relative, i);
+        manifest->_add_key(relative, i);
+    }
+
+    for (auto &result: results) {
+        for (auto &[dir, index]: result.directories) {
+            auto entry = index.empty() ? no_entry : files.at(index);
+            if (!dir.empty()) {
+                manifest->_add_key(dir + "/", entry);
+            }
+            manifest->_add_key(dir, entry);
+            manifest->_directories.push_back(std::move(dir));
+        }
+    }
+
+    manifest->_build_slots();
+    return manifest;
+}
+
+void Manifest::_add_key(std::string path, uint32_t entry) {
+    _keys.push_back({std::move(path), entry});
+}
+
+void Manifest::_build_slots() {
+    size_t slots_count = min_slots_count;
+    while (slots_count < _keys.size() * 2) {
+        slots_count *= 2;
+    }
+    _slots.assign(slots_count, 0);
+    _mask = slots_count - 1;
+
+    for (uint32_t i = 0; i < _keys.size(); ++i) {
+        auto slot = std::hash<std::string_view>{}(_keys[i].path) & _mask;
+        while (_slots[slot] != 0) {
+            slot = (slot + 1) & _mask;
+        }
+        _slots[slot] = i + 1;
+    }
+}
+
+const manifest_entry_t *Manifest::find(std::string_view path, bool &exists) const {
+    exists = false;
+    if (_slots.empty()) {
+        return nullptr;
+    }
+
+    for (auto slot = std::hash<std::string_view>{}(path) & _mask;
+         _slots[slot] != 0; slot = (slot + 1) & _mask) {
+        const auto &key = _keys[_slots[slot] - 1];
+        if (key.path == path) {
+            exists = true;
+            return key.entry == no_entry ? nullptr : &_entries[key.entry];
+        }
+    }
+    return nullptr;
+}
+
+const std::vector<std::string> &Manifest::get_directories() const {
+    return _directories;
+}
+
+size_t Manifest::get_files_count() const {
+    return _entries.size();
+}
+
+}
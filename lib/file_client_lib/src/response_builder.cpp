@@ -0,0 +1,136 @@
+#include "response_builder.hpp"
+
+#include <array>
+#include <charconv>
+#include <limits>
+
+#include "http_date.hpp"
+
+namespace file {
+
+static const size_t initial_size = 1024;
+static const char *divider = "\r\n";
+
+namespace {
+
+struct status_line_t {
+    uint16_t            code;
+    std::string_view    text;
+};
+
+constexpr std::array<status_line_t, (size_t)Status::count> status_lines = {{
+    {200, "200 OK"},
+    {206, "206 Partial Content"},
+    {304, "304 Not Modified"},
+    {400, "400 Bad Request"},
+    {403, "403 Forbidden"},
+    {404, "404 Not Found"},
+    {405, "405 Method Not Allowed"},
+    {414, "414 URI Too Long"},
+    {416, "416 Range Not Satisfiable"},
+    {431, "431 Request Header Fields Too Large"},
+    {505, "505 HTTP Version Not Supported"},
+}};
+
+constexpr size_t max_head_size = 128;
+
+// Head up to the value of Date header
+struct head_t {
+    std::array<char, max_head_size> data{};
+    size_t                          size = 0;
+
+    [[nodiscard]] constexpr std::string_view view() const {
+        return {data.data(), size};
+    }
+};
+
+constexpr head_t make_head(std::string_view status, bool keep_alive) {
+    head_t head;
+    for (auto part: {std::string_view("HTTP/1.1 "), status,
+                     std::string_view("\r\nConnection: "),
+                     std::string_view(keep_alive ? "keep-alive" : "close"),
+                     std::string_view("\r\nServer: httpd\r\nDate: ")}) {
+        for (auto symbol: part) {
+            head.data[head.size++] = symbol;
+        }
+    }
+    return head;
+}
+
+// Indexed by status and keep-alive flag
+using heads_t = std::array<std::array<head_t, 2>, (size_t)Status::count>;
+
+constexpr heads_t make_heads() {
+    heads_t heads;
+    for (size_t i = 0; i < status_lines.size(); ++i) {
+        heads[i][0] = make_head(status_lines[i].text, false);
+        heads[i][1] = make_head(status_lines[i].text, true);
+    }
+    return heads;
+}
+
+constexpr heads_t heads = make_heads();
+
+static_assert(heads[(size_t)Status::headers_too_large][1].size < max_head_size);
+
+}
+
+uint16_t status_code(Status status) {
+    return status_lines[(size_t)status].code;
+}
+
+ResponseBuilder::ResponseBuilder() {
+    _buffer.reserve(initial_size);
+}
+
+void ResponseBuilder::start(Status status, bool keep_alive) {
+    auto head = heads[(size_t)status][keep_alive ? 1 : 0].view();
+    _buffer.assign(head);
+
+    auto size = _buffer.size();
+    _buffer.resize(size + http_date_size);
+    get_current_http_date(_buffer.data() + size);
+    _buffer.append(divider);
+}
+
+void ResponseBuilder::header(std::string_view name, std::string_view value) {
+    _buffer.append(name);
+    _buffer.append(": ");
+    _buffer.append(value);
+    _buffer.append(divider);
+}
+
+void ResponseBuilder::header(std::string_view name, uint64_t value) {
+    _buffer.append(name);
+    _buffer.append(": ");
+    append(value);
+    _buffer.append(divider);
+}
+
+void ResponseBuilder::append(std::string_view data) {
+    _buffer.append(data);
+}
+
+void ResponseBuilder::append(uint64_t value) {
+    char digits[std::numeric_limits<uint64_t>::digits10 + 1];
+    auto result = std::to_chars(std::begin(digits), std::end(digits), value);
+    _buffer.append(digits, result.ptr);
+}
+
+void ResponseBuilder::finish() {
+    _buffer.append(divider);
+}
+
+std::string_view ResponseBuilder::view() const {
+    return _buffer;
+}
+
+size_t ResponseBuilder::size() const {
+    return _buffer.size();
+}
+
+void ResponseBuilder::clear() {
+    _buffer.clear();
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <vector>
+
+#include "concepts.hpp"
+
+namespace bstcp {
+
+class ClientPool;
+
+// Returns a client to the pool it was made in, clients without a pool
+// are deleted as usual
+struct ClientDeleter {
+    ClientPool *pool = nullptr;
+
+    void operator()(IServerClient *client) const;
+};
+
+typedef std::unique_ptr<IServerClient, ClientDeleter> client_ptr;
+
+// Fixed size slots for client objects carved from slabs, so accepting
+// a connection does not go to the allocator. Free slots are linked
+// through their own storage; slabs are kept until the pool is destroyed,
+// which must happen after all its clients are gone.
+class ClientPool {
+  public:
+    struct stats_t {
+        size_t  slabs       = 0;
+        size_t  capacity    = 0;
+        size_t  in_use      = 0;
+        size_t  peak        = 0;
+        size_t  allocated   = 0;
+    };
+
+    static constexpr size_t default_slab_objects = 256;
+
+    ClientPool(size_t object_size, size_t alignment,
+               size_t slab_objects = default_slab_objects);
+
+    ClientPool(const ClientPool&) = delete;
+    ClientPool operator=(const ClientPool&) = delete;
+
+    ~ClientPool();
+
+    template<typename T, typename... Args>
+    client_ptr make(Args&&... args);
+
+    void *allocate();
+
+    void deallocate(void *slot);
+
+    [[nodiscard]] stats_t get_stats() const;
+
+  private:
+    struct free_slot_t {
+        free_slot_t *next;
+    };
+
+    void _add_slab();
+
+    const size_t        _slot_size;
+    const size_t        _alignment;
+    const size_t        _slab_objects;
+
+    mutable std::mutex  _mutex;
+    free_slot_t         *_free  = nullptr;
+    std::vector<void *> _slabs;
+    stats_t             _stats;
+};
+
+template<typename T, typename... Args>
+client_ptr ClientPool::make(Args&&... args) {
+    static_assert(std::is_base_of_v<IServerClient, T>);
+    if (sizeof(T) > _slot_size || alignof(T) > _alignment) {
+        return client_ptr(new T(std::forward<Args>(args)...));
+    }
+
+    auto *slot = allocate();
+    try {
+        return client_ptr(new (slot) T(std::forward<Args>(args)...),
+                          ClientDeleter{this});
+    } catch (...) {
+        deallocate(slot);
+        throw;
+    }
+}
+
+}
@@ -8,9 +8,40 @@
 
 namespace bstcp {
 
+enum class HandleStatus : uint8_t {
+    done        = 0,
+    need_write  = 1,
+    keep_alive  = 2
+};
+
+// What a client waits for, each kind has own time limit
+enum class Timeout : uint8_t {
+    // Taken from the event: idle for reading, write for writing
+    none    = 0,
+    // Next request, nothing of it has been received
+    idle    = 1,
+    // Rest of a started request head
+    header  = 2,
+    // Room in the socket buffer for more output
+    write   = 3,
+    // End of input discarded before closing
+    linger  = 4,
+    count   = 5
+};
+
 class IServerClient: public ISocket {
   public:
-    virtual void handle_request() = 0;
+    virtual HandleStatus handle_request() = 0;
+
+    // Continues sending of response when socket becomes writable
+    virtual HandleStatus handle_write() = 0;
+
+    // Asked after handle_request or handle_write, since is steady time in
+    // ms the limit counts from and is left as is to count from now
+    [[nodiscard]] virtual Timeout get_timeout(int64_t &since) const {
+        (void)since;
+        return Timeout::none;
+    }
 
     ~IServerClient() override = default;
 };
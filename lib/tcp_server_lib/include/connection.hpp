@@ -0,0 +1,195 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "concepts.hpp"
+#include "file_range.hpp"
+#include "frame_pool.hpp"
+#include "output_queue.hpp"
+#include "recv_buffer.hpp"
+#include "tcp_base_socket.hpp"
+
+namespace bstcp {
+
+// Coroutine serving one connection. It starts suspended and runs in the
+// thread handling an event of the connection until it awaits an operation
+// of Connection that can not complete, then the thread goes back to the
+// pool and the session is resumed when the socket becomes ready.
+// An exception ends only this session: it is kept in the promise and the
+// session is done, so the connection is closed.
+// Frames are taken from FramePool, as a session is started per connection.
+class Session {
+  public:
+    struct promise_type {
+        static void *operator new(size_t size) {
+            return FramePool::allocate(size);
+        }
+
+        static void operator delete(void *frame, size_t size) noexcept {
+            FramePool::deallocate(frame, size);
+        }
+
+        Session get_return_object() {
+            return Session(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+
+        void unhandled_exception() noexcept {
+            error = std::current_exception();
+        }
+
+        std::exception_ptr error;
+    };
+
+    Session() = default;
+
+    Session(const Session&) = delete;
+    Session operator=(const Session&) = delete;
+
+    Session(Session&& session) noexcept
+            : _handle(std::exchange(session._handle, nullptr)) {}
+
+    Session& operator=(Session&& session) noexcept {
+        std::swap(_handle, session._handle);
+        return *this;
+    }
+
+    ~Session() {
+        if (_handle) {
+            _handle.destroy();
+        }
+    }
+
+    explicit operator bool() const { return (bool)_handle; }
+
+    [[nodiscard]] bool done() const { return _handle.done(); }
+
+    void resume() { _handle.resume(); }
+
+    // Exception that ended the session, null if there was none
+    [[nodiscard]] std::exception_ptr error() const {
+        return _handle.promise().error;
+    }
+
+  private:
+    explicit Session(std::coroutine_handle<promise_type> handle)
+            : _handle(handle) {}
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+// Socket of a client with its input and output for a Session. Operations
+// are awaitable and complete without suspending while the socket is ready;
+// otherwise the session waits for the socket readiness the operation needs.
+// Only these operations may be awaited by a session.
+class Connection {
+  public:
+    // Operation the suspended session waits for
+    enum class Wait : uint8_t {
+        none    = 0,
+        read    = 1,
+        write   = 2,
+        linger  = 3
+    };
+
+    class Awaiter {
+      public:
+        Awaiter(Connection &connection, Wait wait)
+                : _connection(connection)
+                , _wait(wait) {}
+
+        bool await_ready() { return _connection._try(_wait); }
+
+        void await_suspend(std::coroutine_handle<>) { _connection._suspend(_wait); }
+
+        // Read: false if the peer has closed the connection.
+        // Write: false if the socket failed and output was not sent
+        bool await_resume() const { return _connection._result; }
+
+      private:
+        Connection  &_connection;
+        Wait        _wait;
+    };
+
+    explicit Connection(BaseSocket &&socket);
+
+    Connection(const Connection&) = delete;
+    Connection operator=(const Connection&) = delete;
+
+    Connection(Connection&& connection) noexcept = default;
+
+    // Receives what the socket has into input until it is drained or input
+    // reaches its limit. Data received before the peer closed the
+    // connection is in input even when the result is false.
+    // Waiting with unprocessed input is limited by the header timeout
+    [[nodiscard]] Awaiter read();
+
+    // Sends queued output
+    [[nodiscard]] Awaiter flush();
+
+    // Closes the sending side after flushed output and discards input until
+    // the peer closes its side, so closing the socket with unread data does
+    // not reset the connection before the peer takes the response. Limited
+    // by the linger timeout
+    [[nodiscard]] Awaiter linger();
+
+    [[nodiscard]] Awaiter write(std::string data);
+
+    // Data is not copied, owner keeps it alive until it is sent
+    [[nodiscard]] Awaiter write(std::string_view data, std::shared_ptr<const void> owner);
+
+    [[nodiscard]] Awaiter sendfile(FileRange range);
+
+    [[nodiscard]] RecvBuffer &input();
+
+    // Output queued here is sent together by the next flush
+    [[nodiscard]] OutputQueue &output();
+
+    [[nodiscard]] BaseSocket &socket();
+
+    [[nodiscard]] const BaseSocket &socket() const;
+
+    [[nodiscard]] Wait get_wait() const;
+
+    // Limit of the current wait and steady time in ms it counts from
+    [[nodiscard]] Timeout get_timeout(int64_t &since) const;
+
+    // Retries the operation the session waits for, true if it completed
+    // and the session can be resumed
+    bool ready();
+
+  private:
+    bool _try(Wait wait);
+
+    void _suspend(Wait wait);
+
+    bool _read();
+
+    bool _flush();
+
+    bool _discard();
+
+    BaseSocket  _socket;
+    RecvBuffer  _input;
+    OutputQueue _output;
+    Wait        _wait   = Wait::none;
+    bool        _result = true;
+    bool        _write_shut = false;
+
+    Timeout     _timeout    = Timeout::none;
+    int64_t     _since      = 0;
+    // Input consumed before the wait, a new request restarts the limit
+    size_t      _consumed   = 0;
+};
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "client_pool.hpp"
+
+namespace bstcp {
+
+// Clients of a poller indexed by their sockets. Descriptors are small
+// dense numbers, so a slot is found by the socket itself without a lock.
+// Every slot keeps generation of the registration and its state in one
+// atomic word: while the socket is armed only the poller may take the
+// client, after that the thread handling the event owns it until the
+// socket is armed again or the client is removed.
+// Deadlines of armed clients are kept in a hierarchical timing wheel
+class ConnectionTable {
+  public:
+    struct entry_t {
+        IServerClient   *client     = nullptr;
+        socket_t        socket      = -1;
+        uint32_t        generation  = 0;
+    };
+
+    struct expired_t {
+        entry_t         entry;
+        Timeout         timeout     = Timeout::none;
+    };
+
+    ConnectionTable();
+
+    ConnectionTable(const ConnectionTable&) = delete;
+    ConnectionTable &operator=(const ConnectionTable&) = delete;
+
+    ~ConnectionTable();
+
+    // Data identifying registration in poller events, top two bits are unused
+    static uint64_t key(const entry_t &entry);
+
+    // Steady time in ms deadlines are given in, it is never zero
+    static int64_t now();
+
+    // Registers the client owned by the caller, false if its socket
+    // does not fit the table
+    bool add(client_ptr &&client, entry_t &entry);
+
+    // Takes the client for an event of the registration with the key,
+    // false if the registration is gone or it is not armed
+    bool acquire(uint64_t key, entry_t &entry);
+
+    // Gives the owned client back to the poller before its socket is
+    // armed; deadline is time in ms it expires at for the timeout kind,
+    // zero if it never expires
+    bool arm(const entry_t &entry, int64_t deadline, Timeout timeout);
+
+    // Takes the client back if its socket could not be armed,
+    // false if it has already been taken
+    bool disarm(const entry_t &entry);
+
+    // Removes the owned client, was_armed tells its socket was
+    // armed when the client expired
+    client_ptr remove(const entry_t &entry, bool &was_armed);
+
+    // Takes armed clients whose deadline has passed by now
+    void expire(int64_t now, std::vector<expired_t> &expired);
+
+    // Takes armed clients waiting under the timeout whatever their deadline
+    void expire_all(Timeout timeout, std::vector<expired_t> &expired);
+
+    // Removes armed clients, owned ones are left to their owners
+    template<typename Callback>
+    void clear(Callback &&callback);
+
+  private:
+    static constexpr size_t chunk_size = 4096;
+
+    // Near buckets cover one tick each, far ones a turn of the near wheel
+    static constexpr int64_t tick_ms = 100;
+    static constexpr size_t near_buckets = 256;
+    static constexpr size_t far_buckets = 64;
+    static constexpr int64_t unlinked = -1;
+
+    enum state_t : uint64_t {
+        free        = 0,
+        armed       = 1,
+        busy        = 2,
+        // Expired while its socket was armed
+        closing     = 3
+    };
+
+    struct slot_t {
+        // Generation in the high bits, state in the low byte
+        std::atomic<uint64_t>   tag         {0};
+        std::atomic<int64_t>    deadline    {0};
+        std::atomic<Timeout>    timeout     {Timeout::none};
+        // Tick its wheel bucket is due at
+        std::atomic<int64_t>    due         {unlinked};
+        IServerClient           *client     = nullptr;
+        ClientPool              *pool       = nullptr;
+        socket_t                socket      = -1;
+        // Bucket list, guarded by the wheel mutex
+        slot_t                  *next       = nullptr;
+        slot_t                  **prev      = nullptr;
+    };
+
+    static uint64_t _tag(uint32_t generation, state_t state);
+
+    slot_t *_find(socket_t socket) const;
+
+    slot_t *_get(socket_t socket);
+
+    bool _transit(slot_t &slot, uint32_t generation, state_t from, state_t to);
+
+    entry_t _entry(const slot_t &slot, socket_t socket) const;
+
+    static int64_t _tick(int64_t time);
+
+    // Moves the slot to the bucket due at the tick or the last one before
+    void _link(slot_t &slot, int64_t tick);
+
+    static void _unlink(slot_t &slot);
+
+    // Takes slots of the detached bucket that are due, links others again
+    void _expire_bucket(slot_t *bucket, int64_t now, std::vector<expired_t> &expired);
+
+    std::unique_ptr<std::atomic<slot_t *>[]>    _chunks;
+    size_t                                      _chunks_count;
+    std::atomic<socket_t>                       _max_socket;
+
+    // Slots stay linked when their client is taken or removed and are
+    // checked when their bucket is due, so a later deadline just moves
+    // them then and extending it takes no lock
+    std::mutex                                  _wheel_mutex;
+    std::array<slot_t *, near_buckets>          _near{};
+    std::array<slot_t *, far_buckets>           _far{};
+    // Next tick to expire
+    int64_t                                     _current;
+};
+
+template<typename Callback>
+void ConnectionTable::clear(Callback &&callback) {
+    auto max_socket = _max_socket.load(std::memory_order_acquire);
+    for (socket_t socket = 0; socket <= max_socket; ++socket) {
+        auto *slot = _find(socket);
+        if (slot == nullptr) {
+            // Whole chunk is not allocated
+            socket |= (socket_t)(chunk_size - 1);
+            continue;
+        }
+
+        auto tag = slot->tag.load(std::memory_order_acquire);
+        if ((tag & 0xff) != armed
+            || !_transit(*slot, (uint32_t)(tag >> 8), armed, busy)) {
+            continue;
+        }
+        auto entry = _entry(*slot, socket);
+        callback(entry);
+
+        bool was_armed;
+        remove(entry, was_armed);
+    }
+}
+
+}
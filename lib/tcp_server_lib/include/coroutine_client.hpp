@@ -0,0 +1,76 @@
+#pragma once
+
+#include "concepts.hpp"
+#include "connection.hpp"
+#include "tcp_server.hpp"
+
+namespace bstcp {
+
+// Client written as one coroutine instead of event callbacks. The session
+// is made on the first event, so the client may be moved only before it.
+class CoroutineClient : public IServerClient {
+  public:
+    explicit CoroutineClient(BaseSocket &&socket);
+
+    CoroutineClient(const CoroutineClient&) = delete;
+    CoroutineClient operator=(const CoroutineClient&) = delete;
+
+    CoroutineClient(CoroutineClient &&client) noexcept;
+
+    ~CoroutineClient() override = default;
+
+    HandleStatus handle_request() final;
+
+    HandleStatus handle_write() final;
+
+    [[nodiscard]] uint32_t get_host() const override;
+
+    [[nodiscard]] uint16_t get_port() const override;
+
+    [[nodiscard]] SocketStatus get_status() const override;
+
+    SocketStatus disconnect() override;
+
+    ssize_t recv_from(void *buffer, size_t size) override;
+
+    bool send_to(const void *buffer, int size) const override;
+
+    [[nodiscard]] SocketType get_type() const override;
+
+    socket_t get_socket() override;
+
+    [[nodiscard]] bool is_allow_to_read(long timeout) const override;
+
+    [[nodiscard]] bool is_allow_to_write(long timeout) const override;
+
+    [[nodiscard]] bool is_allow_to_rwrite(long timeout) const override;
+
+    [[nodiscard]] Timeout get_timeout(int64_t &since) const override;
+
+  protected:
+    // Serves the connection until it has to be closed
+    virtual Session serve() = 0;
+
+    Connection  _connection;
+
+  private:
+    status accept(const std::unique_ptr<ISocket>& server_socket) override;
+
+    HandleStatus _resume();
+
+    // Event the session waits for, reading also waits for next request
+    [[nodiscard]] HandleStatus _wait_status() const;
+
+    Session     _session;
+};
+
+#if __cplusplus > 201703L && __cpp_concepts >= 201907L
+template<typename T, class Socket = BaseSocket>
+concept coroutine_client = server_client<T, Socket>
+                           && std::is_base_of_v<CoroutineClient, T>;
+
+template<coroutine_client<BaseSocket> T>
+using CoroutineTcpServer = TcpServer<BaseSocket, T>;
+#endif
+
+}
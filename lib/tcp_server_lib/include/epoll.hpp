@@ -1,79 +1,47 @@
 #pragma once
 
-#include <map>
+#include <sys/epoll.h>
 
-#include "concepts.hpp"
-
-const size_t number_events = 20;
+#include "poller.hpp"
 
 namespace bstcp {
 
 typedef int epoll_fd_t;
 
-class Epoll {
+class Epoll : public Poller {
   public:
-    struct Client {
-      public:
-        Client();
-
-        explicit Client(std::shared_ptr<IServerClient>&& client);
-
-        void lock() const;
-
-        [[nodiscard]] bool try_lock() const;
-
-        [[nodiscard]] const std::shared_ptr<IServerClient>& get_client() const;
-
-        void unlock() const;
-
-        ~Client() = default;
-
-      private:
-        std::shared_ptr<std::mutex>     _access_mtx;
-        std::shared_ptr<IServerClient>  _client;
-    };
-
-    enum event_t: uint16_t {
-        close       = 0,
-        can_read    = 1,
-        need_accept = 2,
-        err         = 3
-    };
-
-    struct epoll_event_t {
-        Client    client;
-        event_t   event;
-    };
-
     Epoll();
 
-    bool add_server_socket(std::unique_ptr<ISocket> server);
+    ~Epoll() override;
 
-    void stop();
+    [[nodiscard]] PollerType get_type() const override;
 
-    bool add_client(std::unique_ptr<IServerClient>&& client);
+    bool add_server_socket(std::unique_ptr<ISocket> server) override;
 
-    std::vector<epoll_event_t> wait();
+    void stop() override;
 
-    bool delete_client(const std::shared_ptr<IServerClient>& client);
+    bool add_client(client_ptr&& client) override;
 
-    bool delete_client(socket_t socket);
+    void wait(std::vector<epoll_event_t> &selected) override;
 
-    std::vector<Client> get_clients();
+    client_ptr delete_client(const Client &client) override;
 
-    void delete_all();
+    bool rearm_client(const Client &client, event_t event) override;
 
-    [[nodiscard]] const std::unique_ptr<ISocket>& get_server() const;
+    void delete_all() override;
 
   private:
+    void _stop_listening() override;
 
-    bool _delete_ctl(socket_t socket) const;
+    // Polls for a while first if busy polling is on, then blocks
+    int _wait_events(std::vector<struct epoll_event> &events, size_t batch);
+
+    // Gives the client back to the table and arms its socket
+    bool _arm(const Client &client, int operation, event_t event);
 
-    std::map<size_t, Client> _clients;
+    bool _delete_ctl(socket_t socket) const;
 
-    std::mutex                  _mutex;
     epoll_fd_t                  _epoll_fd;
-    std::unique_ptr<ISocket>    _serv_socket;
 };
 
-}
\ No newline at end of file
+}
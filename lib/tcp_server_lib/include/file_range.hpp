@@ -0,0 +1,55 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include "tcp_utilits.hpp"
+
+namespace bstcp {
+
+enum class TransferStatus : uint8_t {
+    done        = 0,
+    would_block = 1,
+    error       = 2
+};
+
+// Part of a file sent to the socket without copying it to user space.
+// Uses sendfile(2) and falls back to splice(2) through a pipe when the
+// file system does not support sendfile. Keeps its position, so a send
+// interrupted by a full socket buffer resumes where it stopped.
+class FileRange {
+  public:
+    FileRange() = default;
+
+    FileRange(int file_fd, off_t offset, size_t size);
+
+    FileRange(const FileRange&) = delete;
+    FileRange operator=(const FileRange&) = delete;
+
+    FileRange(FileRange&& range) noexcept;
+
+    FileRange& operator=(FileRange&& range) noexcept;
+
+    ~FileRange();
+
+    TransferStatus send_to(socket_t socket);
+
+    [[nodiscard]] bool empty() const;
+
+    [[nodiscard]] size_t size() const;
+
+    void reset();
+
+  private:
+    TransferStatus _sendfile(socket_t socket);
+
+    TransferStatus _splice(socket_t socket);
+
+    int     _file_fd    = -1;
+    off_t   _offset     = 0;
+    size_t  _remain     = 0;
+    bool    _use_splice = false;
+    int     _pipe[2]    = {-1, -1};
+    size_t  _in_pipe    = 0;
+};
+
+}
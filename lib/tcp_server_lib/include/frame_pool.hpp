@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+namespace bstcp {
+
+// Storage of coroutine frames of sessions. Sizes are rounded up to slot
+// classes and every thread keeps own free slots of each class, so a frame
+// of a new session reuses memory of a finished one without locking.
+// Frames larger than the biggest class go to the global operator new
+class FramePool {
+  public:
+    static constexpr size_t slot_step = 64;
+    static constexpr size_t max_slot_size = 16 * 1024;
+    // Free slots of one class kept by a thread, others are freed
+    static constexpr size_t local_size = 256;
+
+    FramePool() = delete;
+
+    static void *allocate(size_t size);
+
+    static void deallocate(void *frame, size_t size) noexcept;
+
+  private:
+    struct local_t;
+
+    static thread_local local_t _local;
+};
+
+}
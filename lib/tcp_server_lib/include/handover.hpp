@@ -0,0 +1,32 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "tcp_utilits.hpp"
+
+namespace bstcp {
+
+// Listening sockets passed to a new process of the server on reload. They
+// are inherited through exec and listed in BSTCP_LISTEN_FDS, the successor
+// reports it is ready by writing to the pipe in BSTCP_READY_FD, so the old
+// process stops accepting only once the new one does.
+class Handover {
+  public:
+    // Sockets handed over by the parent, empty if the process was started
+    // another way. Taken once, the variables are removed from environment
+    static std::vector<socket_t> take_sockets();
+
+    // Tells the parent that the sockets are in use, nothing if not handed over
+    static void notify_ready();
+
+    // Starts the program of argv with the sockets and waits until it is
+    // ready. Pid of the successor, -1 if it failed or was not ready in time,
+    // then it is terminated
+    static pid_t spawn(char *const argv[], const std::vector<socket_t> &sockets,
+                       std::chrono::milliseconds timeout);
+};
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include "poller.hpp"
+
+namespace bstcp {
+
+// Poller on io_uring driven by raw syscalls. Every wait is a poll
+// request in the submission ring; requests made from the thread running
+// the loop are only queued and reach the kernel with the next wait in
+// the same io_uring_enter call, so rearming a client costs no syscall.
+// Requests from other threads while the loop waits are submitted at once.
+// The listening socket has one multishot accept, so every connection comes
+// as own completion with the accepted socket and needs no accept syscall;
+// kernels without it get a poll of the socket instead. Clients still read
+// and write on readiness, as their buffers live in the client code.
+class IoUring : public Poller {
+  public:
+    IoUring();
+
+    ~IoUring() override;
+
+    // False if the kernel does not support io_uring or its features in use
+    [[nodiscard]] bool is_valid() const;
+
+    [[nodiscard]] PollerType get_type() const override;
+
+    bool add_server_socket(std::unique_ptr<ISocket> server) override;
+
+    void stop() override;
+
+    bool add_client(client_ptr&& client) override;
+
+    void wait(std::vector<epoll_event_t> &selected) override;
+
+    client_ptr delete_client(const Client &client) override;
+
+    bool rearm_client(const Client &client, event_t event) override;
+
+    void delete_all() override;
+
+  private:
+    void _stop_listening() override;
+
+    bool _setup(unsigned entries);
+
+    struct io_uring_sqe *_get_sqe();
+
+    void _commit_sqe();
+
+    // False if the submission ring is full and the kernel takes no more
+    bool _poll_add(socket_t socket, uint32_t events, uint64_t data);
+
+    // False if the submission ring is full and the kernel takes no more
+    bool _accept(socket_t socket);
+
+    // Cancels a poll or accept; a cancel that does not fit into the ring
+    // is retried by the next wait
+    void _cancel(uint64_t data);
+
+    void _retry_removals();
+
+    [[nodiscard]] unsigned _queued() const;
+
+    // Sends queued requests to the kernel, -errno if it failed. Requests
+    // it has not taken stay queued and go with the next call
+    int _submit();
+
+    // Sends requests and waits for at least one completion or timeout
+    int _submit_and_wait(unsigned to_submit);
+
+    void _submit_if_waiting();
+
+    // Gives the client back to the table and polls its socket
+    bool _arm(const Client &client, event_t event);
+
+    void _remove_polls();
+
+    void _handle_server(const struct io_uring_cqe &cqe,
+                        std::vector<epoll_event_t> &selected);
+
+    void _handle_completion(const struct io_uring_cqe &cqe,
+                            std::vector<epoll_event_t> &selected);
+
+    int         _ring_fd    = -1;
+    void        *_ring      = nullptr;
+    size_t      _ring_size  = 0;
+
+    struct io_uring_sqe *_sqes      = nullptr;
+    size_t              _sqes_size  = 0;
+    unsigned            *_sq_head   = nullptr;
+    unsigned            *_sq_tail   = nullptr;
+    unsigned            _sq_mask    = 0;
+    unsigned            _sq_entries = 0;
+    unsigned            _sq_local_tail = 0;
+
+    struct io_uring_cqe *_cqes      = nullptr;
+    unsigned            *_cq_head   = nullptr;
+    unsigned            *_cq_tail   = nullptr;
+    unsigned            _cq_mask    = 0;
+
+    // Guards the rings, clients are in the lock-free table
+    std::mutex  _mutex;
+    bool        _waiting        = false;
+    bool        _server_armed   = false;
+    bool        _listening      = true;
+    // Cleared if the kernel rejects multishot accept
+    bool        _multishot      = true;
+    std::vector<uint64_t>   _pending_removals;
+};
+
+}
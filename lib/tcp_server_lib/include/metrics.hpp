@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace bstcp {
+
+enum class Histogram : uint8_t {
+    // Accept of a connection until it is added to the poller
+    accept_latency  = 0,
+    // Task waiting in prll::Parallel until a worker runs it
+    queue_wait      = 1,
+    parse_time      = 2,
+    lookup_time     = 3,
+    // Flush of queued output to the socket
+    send_time       = 4,
+    count           = 5
+};
+
+enum class Counter : uint8_t {
+    accepted_connections    = 0,
+    requests                = 1,
+    bytes_out               = 2,
+    // Access log entries lost because the writer fell behind
+    log_dropped             = 3,
+    // Connections closed by their time limits
+    idle_timeouts           = 4,
+    header_timeouts         = 5,
+    write_timeouts          = 6,
+    // Sessions ended by an exception, only their connections are closed
+    session_errors          = 7,
+    count                   = 8
+};
+
+// Process-wide metrics. Every thread records into own block with relaxed
+// stores, so recording takes no locks and shares no cache lines; blocks
+// are merged only when the metrics are rendered. Histograms keep
+// nanoseconds in log-linear buckets with 8 sub-buckets per power of two,
+// so any value is known within 12.5%.
+class Metrics {
+  public:
+    // Steady clock in nanoseconds
+    static int64_t now();
+
+    static void record(Histogram histogram, int64_t duration_ns);
+
+    static void add(Counter counter, uint64_t value = 1);
+
+    // Value sampled on each render, for example number of connections
+    static void add_gauge(std::string name, std::string help,
+                          std::function<double()> value);
+
+    // Text exposition format of Prometheus
+    static std::string render();
+};
+
+}
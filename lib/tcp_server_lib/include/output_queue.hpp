@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_range.hpp"
+#include "tcp_base_socket.hpp"
+
+namespace bstcp {
+
+// Data waiting to be sent to a connection in order of adding: owned
+// buffers, buffers kept alive by a shared owner and file ranges.
+// Consecutive buffers are sent with one writev, files with sendfile.
+// Keeps the position, so flush resumes after a full socket buffer.
+// Sent segments are kept with memory of their buffers for the next data.
+class OutputQueue {
+  public:
+    OutputQueue() = default;
+
+    OutputQueue(const OutputQueue&) = delete;
+    OutputQueue operator=(const OutputQueue&) = delete;
+
+    OutputQueue(OutputQueue&& queue) noexcept = default;
+
+    OutputQueue& operator=(OutputQueue&& queue) noexcept = default;
+
+    void push(std::string data);
+
+    // Data is not copied, owner keeps it alive until it is sent
+    void push(std::string_view data, std::shared_ptr<const void> owner);
+
+    void push(FileRange range);
+
+    // Copies data after the last buffer, so it is sent in the same piece
+    void append(std::string_view data);
+
+    TransferStatus flush(BaseSocket &socket);
+
+    [[nodiscard]] bool empty() const;
+
+    // Bytes of buffers and files added over the life of the queue
+    [[nodiscard]] size_t get_pushed() const;
+
+    // Queue is long enough to be flushed before adding more
+    [[nodiscard]] bool is_full() const;
+
+    void clear();
+
+  private:
+    struct segment_t {
+        std::string                 buffer;
+        std::string_view            data;
+        std::shared_ptr<const void> owner;
+        FileRange                   file;
+        bool                        is_file = false;
+        size_t                      sent    = 0;
+
+        [[nodiscard]] std::string_view rest() const;
+    };
+
+    TransferStatus _send_buffers(BaseSocket &socket);
+
+    segment_t &_emplace_back();
+
+    void _pop_front();
+
+    [[nodiscard]] size_t _size() const;
+
+    // Segments from _first to _end are queued, the rest wait for reuse
+    std::vector<segment_t>  _segments;
+    size_t                  _first = 0;
+    size_t                  _end = 0;
+    size_t                  _buffered = 0;
+    size_t                  _pushed = 0;
+};
+
+}
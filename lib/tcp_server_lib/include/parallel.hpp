@@ -1,14 +1,22 @@
+#pragma once
+
 #include <atomic>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
-#include <queue>
-#include <list>
-#include <functional>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "task.hpp"
+#include "work_stealing_deque.hpp"
 
 namespace prll {
 #define MAXNTHREADS (size_t)50
 
+// Fixed pool of workers. Each worker has own deque of tasks, idle
+// workers steal tasks from the others. Tasks added from outside
+// of the pool go through the shared queue.
 class Parallel {
   public:
     Parallel();
@@ -17,58 +25,34 @@ class Parallel {
     void add(Callable &&f, Args &&... args) {
         if (_max_threads == 0) {
             f(args...);
-        } else {
-            {
-                std::lock_guard<std::mutex> thr_lck(_thread_mutex);
-                if (_threads.size() < _max_threads) {
-                    _threads.emplace_back(new Thread([f, args...] {
-                        f(args...);
-                    }, _wait));
-                    return;
-                }
-            }
-
-            {
-                std::lock_guard<std::mutex> lck(_task_mutex);
-
-                if (_exit) {
-                    return;
-                }
-
-                _tasks.push(std::move([f, args...] {
-                    f(args...);
-                }));
-            }
-
-            _wait.notify_one();;
+            return;
         }
+
+        auto *task = _make_task();
+        task->set([f = std::forward<Callable>(f),
+                   ...args = std::forward<Args>(args)]() mutable {
+            f(args...);
+        });
+        _push(task);
+        _notify(1);
     }
 
     template<typename Callable>
     void add_multi(const std::vector<Callable>& f) {
-        size_t i = 0;
-        {
-            std::lock_guard<std::mutex> thr_lck(_thread_mutex);
-            while (i < f.size() && _threads.size() < _max_threads) {
-                _threads.emplace_back(new Thread(f[i], _wait));
-                ++i;
+        if (_max_threads == 0) {
+            for (const auto &func: f) {
+                func();
             }
-        }
-        if (i >= f.size()) {
-            return;
-        }
-
-        std::lock_guard<std::mutex> lck(_task_mutex);
-
-        if (_exit) {
             return;
         }
 
-        for (; i < f.size(); ++i) {
-            _tasks.push(std::move(f[i]));
+        // Owner takes tasks from its deque in reverse order
+        for (auto it = f.rbegin(); it != f.rend(); ++it) {
+            auto *task = _make_task();
+            task->set(*it);
+            _push(task);
         }
-
-        _wait.notify_one();;
+        _notify(f.size());
     }
 
     void join();
@@ -82,42 +66,45 @@ class Parallel {
     ~Parallel();
 
   private:
+    struct Worker {
+        WorkStealingDeque       tasks;
+        Task                    *free_tasks = nullptr;
+        std::atomic<Task *>     returned_tasks = nullptr;
+        std::thread             thread;
+    };
 
-    class Thread {
-      public:
-        Thread() = delete;
+    static constexpr size_t external_owner = (size_t)-1;
 
-        Thread(std::function<void()> task,
-               std::condition_variable &threads);
+    Task *_make_task();
 
-        Thread(Thread &&) noexcept = delete;
+    void _push(Task *task);
 
-        void join();
+    void _notify(size_t count);
 
-        [[nodiscard]] bool is_finished() const;
+    void _recycle(Task *task);
 
-        ~Thread();
+    Task *_find_task(size_t index);
 
-      private:
+    void _worker_main(size_t index);
 
-        void _main();
+    void _start_workers();
 
-        std::thread                 _main_thread;
-        std::atomic<long>           _have_proccess;
-        std::condition_variable&    _wait;
-        std::function<void(void)>   _task;
-    };
+    void _stop_workers();
 
-    void _supervisor();
+    [[nodiscard]] size_t _current_worker() const;
 
-    bool                                    _exit = false;
+    std::atomic<bool>                       _exit = false;
+    std::atomic<bool>                       _running = false;
     size_t                                  _max_threads;
+    std::vector<std::unique_ptr<Worker>>    _workers;
+
     std::mutex                              _task_mutex;
-    std::mutex                              _thread_mutex;
-    std::condition_variable                 _wait;
-    std::list<std::unique_ptr<Thread>>      _threads;
-    std::queue<std::function<void(void)>>   _tasks;
+    std::deque<Task *>                      _tasks;
 
-    std::thread _main_thread;
+    std::atomic<size_t>                     _pending  = 0;
+    std::atomic<size_t>                     _sleeping = 0;
+    std::mutex                              _sleep_mutex;
+    std::condition_variable                 _wait;
+    std::condition_variable                 _stopped;
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+
+#include "connection_table.hpp"
+
+namespace bstcp {
+
+enum class PollerType : uint8_t {
+    epoll       = 0,
+    io_uring    = 1
+};
+
+// Readiness notifications for the listening socket and its clients.
+// Clients are registered as one-shot, so after every event the client
+// must be rearmed for the next one it waits for
+class Poller {
+  public:
+    // Client taken with an event, the caller owns it until the client
+    // is rearmed or deleted
+    typedef ConnectionTable::entry_t Client;
+
+    enum event_t: uint16_t {
+        close       = 0,
+        can_read    = 1,
+        need_accept = 2,
+        err         = 3,
+        can_write   = 4,
+        // Poller has accepted a connection itself, its socket is in
+        // client.socket and client.client is null
+        accepted    = 5
+    };
+
+    struct epoll_event_t {
+        Client    client;
+        event_t   event;
+    };
+
+    struct wait_config_t {
+        // Events taken by one wait, the upper bound when it is adaptive
+        size_t                      max_events  = 128;
+        // Longest time one wait blocks without events
+        std::chrono::milliseconds   timeout     = std::chrono::seconds(1);
+        // Batch doubles while waits fill it and halves when they leave
+        // most of it empty
+        bool                        adaptive    = false;
+        // After a wait with events the next one polls without blocking
+        // for this time before it sleeps, 0 disables it
+        std::chrono::microseconds   busy_poll   = std::chrono::microseconds(0);
+    };
+
+    // Limits of what clients wait for, see Timeout; zero disables one.
+    // Head limit counts from the first wait for it, so a client sending
+    // a byte at a time can not extend it
+    struct timeouts_t {
+        std::chrono::milliseconds   idle    = std::chrono::seconds(15);
+        std::chrono::milliseconds   header  = std::chrono::seconds(10);
+        // Time without progress of a write
+        std::chrono::milliseconds   write   = std::chrono::seconds(60);
+        std::chrono::milliseconds   linger  = std::chrono::seconds(2);
+    };
+
+    Poller();
+
+    Poller(const Poller&) = delete;
+    Poller operator=(const Poller&) = delete;
+
+    virtual ~Poller() = default;
+
+    // Makes poller of the given type, epoll is used if it is unavailable
+    static std::unique_ptr<Poller> create(PollerType type);
+
+    [[nodiscard]] virtual PollerType get_type() const = 0;
+
+    virtual bool add_server_socket(std::unique_ptr<ISocket> server) = 0;
+
+    virtual void stop() = 0;
+
+    // Stops accepting and closes the listening socket, unless other process
+    // shares it. Clients waiting for the next request are closed by the next
+    // wait and others once they wait for one. Called again it closes clients
+    // that have started to wait for the next request since
+    void drain();
+
+    virtual bool add_client(client_ptr&& client) = 0;
+
+    // Replaces content of selected, so a loop keeps one vector for all waits
+    virtual void wait(std::vector<epoll_event_t> &selected) = 0;
+
+    // Returns ownership of the client, nullptr if it is not registered
+    virtual client_ptr delete_client(const Client &client) = 0;
+
+    virtual bool rearm_client(const Client &client, event_t event) = 0;
+
+    virtual void delete_all() = 0;
+
+    // Clients waiting longer than their limit are returned from wait()
+    // with close event
+    void set_timeouts(const timeouts_t &timeouts);
+
+    // Used by waits started after it, so it is set before the loop runs
+    void set_wait_config(const wait_config_t &config);
+
+    [[nodiscard]] const std::unique_ptr<ISocket>& get_server() const;
+
+    // Storage for clients accepted from this poller
+    void set_client_pool(std::unique_ptr<ClientPool> pool);
+
+    [[nodiscard]] ClientPool *get_client_pool() const;
+
+    // Steady time in ms of deadlines, it is never zero
+    static int64_t now();
+
+  protected:
+    // Gives the owned client back to the table with the deadline of
+    // what it waits for, before its socket is armed for the event.
+    // False if the deadline has passed, then the caller closes it
+    bool _give_back(const Client &client, event_t event);
+
+    void _expire(std::vector<epoll_event_t> &selected);
+
+    // Takes the listening socket out of waits
+    virtual void _stop_listening() = 0;
+
+    // Descriptor stays taken by an unbound socket until the poller stops, so
+    // an accept running in other thread fails instead of taking a descriptor
+    // reused meanwhile; the port is released unless other process shares it
+    void _close_listener();
+
+    // Outlives the clients in the table
+    std::unique_ptr<ClientPool> _client_pool;
+    ConnectionTable             _clients;
+
+    wait_config_t           _wait_config;
+    // In ms, indexed by Timeout
+    std::array<std::atomic<int64_t>, (size_t)Timeout::count>   _timeouts{};
+    std::atomic<int64_t>    _next_expire;
+    std::atomic<bool>       _draining   = false;
+    std::atomic<bool>       _close_idle = false;
+
+    std::unique_ptr<ISocket>    _serv_socket;
+};
+
+}
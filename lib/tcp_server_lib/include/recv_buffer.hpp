@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace bstcp {
+
+// Storage of fixed size blocks for receive buffers, so a connection holds
+// memory only while it has unprocessed input. Every thread keeps own free
+// blocks and moves them to or from the shared list in batches, so taking
+// and returning a block does not lock
+class BufferPool {
+  public:
+    static constexpr size_t block_size = 16 * 1024;
+    // Free blocks kept by one thread, half of them are moved at once
+    static constexpr size_t local_size = 64;
+    // Free blocks kept in the shared list, others are freed
+    static constexpr size_t max_free = 1024;
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool operator=(const BufferPool&) = delete;
+
+    ~BufferPool();
+
+    static BufferPool &instance();
+
+    char *acquire();
+
+    void release(char *block);
+
+  private:
+    struct local_t;
+
+    BufferPool() = default;
+
+    // Moves up to count blocks from the shared list to blocks
+    void _take(std::vector<char *> &blocks, size_t count);
+
+    // Moves count blocks from the end of blocks to the shared list
+    void _give(std::vector<char *> &blocks, size_t count);
+
+    std::mutex          _mutex;
+    std::vector<char *> _free;
+
+    static thread_local local_t _local;
+};
+
+// Receive buffer of a connection. Data is read to the tail and consumed
+// from the head; when the tail reaches the end of storage the unread part
+// is moved to the start, so the readable data always stays contiguous
+// for the parser. Grows past one pool block only for large input.
+class RecvBuffer {
+  public:
+    RecvBuffer() = default;
+
+    RecvBuffer(const RecvBuffer&) = delete;
+    RecvBuffer operator=(const RecvBuffer&) = delete;
+
+    RecvBuffer(RecvBuffer&& buffer) noexcept;
+
+    RecvBuffer& operator=(RecvBuffer&& buffer) noexcept;
+
+    ~RecvBuffer();
+
+    [[nodiscard]] std::string_view data() const;
+
+    [[nodiscard]] size_t size() const;
+
+    [[nodiscard]] bool empty() const;
+
+    void consume(size_t size);
+
+    // Bytes consumed over the life of the buffer
+    [[nodiscard]] size_t get_consumed() const;
+
+    // Makes room for at least min_space bytes and returns the tail
+    char *prepare(size_t min_space);
+
+    // Free space at the tail after prepare
+    [[nodiscard]] size_t space() const;
+
+    void commit(size_t size);
+
+    // Returns storage to the pool if there is no unread data
+    void release();
+
+  private:
+    void _free();
+
+    char    *_data      = nullptr;
+    size_t  _capacity   = 0;
+    size_t  _begin      = 0;
+    size_t  _end        = 0;
+    size_t  _consumed   = 0;
+};
+
+}
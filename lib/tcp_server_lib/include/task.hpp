@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace prll {
+
+const size_t task_storage_size = 64;
+
+// Type-erased callable with inline storage. Unlike std::function it does
+// not allocate for small callables and is reused by the pool after run.
+class Task {
+  public:
+    Task() = default;
+
+    Task(const Task&) = delete;
+    Task operator=(const Task&) = delete;
+
+    ~Task() {
+        reset();
+    }
+
+    template<typename Callable>
+    void set(Callable &&f) {
+        using callable_t = std::decay_t<Callable>;
+
+        reset();
+        if constexpr (sizeof(callable_t) <= task_storage_size
+                      && alignof(callable_t) <= alignof(std::max_align_t)) {
+            _callable = new(_storage) callable_t(std::forward<Callable>(f));
+            _destroy = [](void *callable) {
+                static_cast<callable_t *>(callable)->~callable_t();
+            };
+        } else {
+            _callable = new callable_t(std::forward<Callable>(f));
+            _destroy = [](void *callable) {
+                delete static_cast<callable_t *>(callable);
+            };
+        }
+        _invoke = [](void *callable) {
+            (*static_cast<callable_t *>(callable))();
+        };
+    }
+
+    void operator()() {
+        _invoke(_callable);
+    }
+
+    void reset() {
+        if (_destroy) {
+            _destroy(_callable);
+        }
+        _callable = nullptr;
+        _invoke = nullptr;
+        _destroy = nullptr;
+    }
+
+  private:
+    friend class Parallel;
+
+    alignas(std::max_align_t) unsigned char _storage[task_storage_size];
+
+    void    *_callable = nullptr;
+    void    (*_invoke)(void *) = nullptr;
+    void    (*_destroy)(void *) = nullptr;
+
+    Task    *_next  = nullptr;
+    size_t  _owner  = 0;
+    // Steady time the task was queued at, for queue wait metric
+    int64_t _queued_at = 0;
+};
+
+}
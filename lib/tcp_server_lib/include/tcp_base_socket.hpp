@@ -22,8 +22,16 @@ class BaseSocket : public ISocket {
 
     status init(uint32_t host, uint16_t port, uint16_t type);
 
+    // Takes a socket opened elsewhere, for example one inherited from
+    // other process
+    status attach(socket_t socket, uint16_t type);
+
     status accept(const std::unique_ptr<ISocket>& server_socket);
 
+    // Takes a client socket the poller has accepted; the socket is owned
+    // even if its peer address can not be read
+    status adopt(socket_t socket);
+
     ~BaseSocket() override;
 
     [[nodiscard]] uint32_t get_host() const override;
@@ -34,10 +42,16 @@ class BaseSocket : public ISocket {
 
     status disconnect() override;
 
-    bool recv_from(void *buffer, int size) override;
+    ssize_t recv_from(void *buffer, size_t size) override;
 
     bool send_to(const void *buffer, int size) const override;
 
+    // Returns number of sent bytes, 0 if socket buffer is full, -1 on error
+    ssize_t send_some(const void *buffer, size_t size, bool more = false) const;
+
+    // Same as send_some for several buffers in one call
+    ssize_t send_vector(const struct iovec *iov, size_t count, bool more = false) const;
+
     [[nodiscard]] SocketType get_type() const override;
 
     socket_t get_socket() override;
@@ -15,8 +15,9 @@
 #include <cstdlib>
 
 #include "concepts.hpp"
+#include "metrics.hpp"
 #include "parallel.hpp"
-#include "epoll.hpp"
+#include "poller.hpp"
 
 namespace bstcp {
 
@@ -66,6 +67,41 @@ public:
 
     void joinLoop();
 
+    // Stops accepting and waits until clients finish what they have started,
+    // false if some are still busy after the timeout
+    bool drain(std::chrono::milliseconds timeout);
+
+    // Listening sockets of the running server, to be handed over
+    [[nodiscard]] std::vector<socket_t> get_listen_sockets() const;
+
+    // Listening sockets used by the next start instead of new ones,
+    // the ones left over are closed
+    void set_inherited_sockets(std::vector<socket_t> sockets);
+
+    // Limits of all waits of clients
+    void set_timeouts(const Poller::timeouts_t &timeouts);
+
+    // Number of event loops, each with own epoll and own listening socket
+    // bound with SO_REUSEPORT. 0 means single epoll feeding the thread pool
+    void set_event_loops(size_t count);
+
+    // Batch size, timeout and busy polling of waits for events,
+    // used by pollers made by the next start
+    void set_wait_config(const Poller::wait_config_t &config);
+
+    // Connections are reported by the next start only once request data
+    // has arrived or the timeout has passed, 0 reports them on handshake
+    void set_defer_accept(std::chrono::seconds timeout);
+
+    // Multiplexer used by the next start, epoll if io_uring is unavailable
+    void set_poller(PollerType type);
+
+    // Multiplexer actually in use after start
+    [[nodiscard]] PollerType get_poller_type() const;
+
+    // Occupancy of client pools summed over all pollers
+    [[nodiscard]] ClientPool::stats_t get_client_stats() const;
+
     // Server client management
     bool connect_to(uint32_t host, uint16_t port,
                    const _con_handler_function_t& connect_hndl);
@@ -73,21 +109,51 @@ public:
     void disconnect_all();
 
   private:
-    Epoll           _epoll;
-    uint16_t        _port;
-    std::mutex      _epoll_mutex;
-    ServerStatus    _status  = ServerStatus::close;
-    prll::Parallel  _thread_pool;
-    KeepAliveConfig _ka_conf;
+    std::unique_ptr<Poller>     _epoll;
+    PollerType                  _poller_type = PollerType::epoll;
+    uint16_t                    _port;
+    std::mutex                  _epoll_mutex;
+    std::atomic<ServerStatus>   _status  = ServerStatus::close;
+    prll::Parallel              _thread_pool;
+    KeepAliveConfig             _ka_conf;
+
+    size_t                              _event_loops = 0;
+    std::vector<std::unique_ptr<Poller>> _reactors;
+    Poller::timeouts_t                  _timeouts;
+    std::chrono::seconds                _defer_accept = std::chrono::seconds(0);
+    Poller::wait_config_t               _wait_config;
+    std::vector<socket_t>               _inherited;
+
+    // Connections accepted per wake-up, the rest of backlog is reported again
+    static constexpr size_t _accept_batch_size = 64;
 
     _con_handler_function_t _connect_hndl       = _default_connsection_handler;
     _con_handler_function_t _disconnect_hndl    = _default_connsection_handler;
 
     bool _enable_keep_alive(socket_t socket);
 
-    void _accept_loop(const std::unique_ptr<ISocket> &server);
+    ServerStatus _init_server_socket(uniq_ptr<Socket> &serv_socket, uint16_t type);
+
+    ServerStatus _start_event_loops();
+
+    void _close_inherited();
+
+    // Poller with own pool for clients it accepts
+    std::unique_ptr<Poller> _make_poller() const;
+
+    void _accept_loop(Poller &epoll);
+
+    // Client of a socket accepted by the poller
+    void _adopt(Poller &epoll, socket_t socket);
+
+    void _add_accepted(Poller &epoll, Socket &&client_socket, int64_t start);
 
     void _waiting_recv_loop();
+
+    void _event_loop(Poller &epoll);
+
+    void _process_client(Poller &epoll, const Poller::Client &client,
+                         Poller::event_t event);
 };
 
 
@@ -12,7 +12,8 @@ TcpServer<Socket, T>::TcpServer(uint16_t port,
                                 _con_handler_function_t disconnect_hndl,
                                 size_t thread_count
 )
-        : _port(port)
+        : _epoll(Poller::create(PollerType::epoll))
+          , _port(port)
           , _thread_pool()
           , _ka_conf(ka_conf)
           , _connect_hndl(std::move(connect_hndl))
@@ -46,42 +47,175 @@ TcpServer<Socket, T>::start() {
         stop();
     }
 
-    uniq_ptr<Socket> serv_socket(new Socket());
-    auto sts = serv_socket->init(localhost, _port,
-                                 (uint16_t) SocketType::nonblocking_socket
-                                 | (uint16_t) SocketType::server_socket);
-    switch (sts) {
+    if (_event_loops > 0) {
+        return _start_event_loops();
+    }
+
+    uniq_ptr<Socket> serv_socket;
+    auto sts = _init_server_socket(serv_socket,
+                                   (uint16_t) SocketType::nonblocking_socket
+                                   | (uint16_t) SocketType::server_socket);
+    if (sts != ServerStatus::up) {
+        return _status = sts;
+    }
+    _epoll = _make_poller();
+    _epoll->add_server_socket(std::move(serv_socket));
+    _close_inherited();
+
+    _status = ServerStatus::up;
+    _thread_pool.add([this] { _waiting_recv_loop(); });
+
+    return _status;
+}
+
+SOCKET_TEMPLATE
+typename bstcp::TcpServer<Socket, T>::ServerStatus
+TcpServer<Socket, T>::_start_event_loops() {
+    _reactors.clear();
+    for (size_t i = 0; i < _event_loops; ++i) {
+        uniq_ptr<Socket> serv_socket;
+        auto sts = _init_server_socket(serv_socket,
+                                       (uint16_t) SocketType::nonblocking_socket
+                                       | (uint16_t) SocketType::server_socket
+                                       | (uint16_t) SocketType::reuse_port);
+        if (sts != ServerStatus::up) {
+            _reactors.clear();
+            return _status = sts;
+        }
+
+        auto &epoll = _reactors.emplace_back(_make_poller());
+        epoll->add_server_socket(std::move(serv_socket));
+    }
+    _close_inherited();
+
+    _status = ServerStatus::up;
+    _thread_pool.set_max_threads(_event_loops);
+    for (auto &epoll: _reactors) {
+        _thread_pool.add([this, &epoll = *epoll] { _event_loop(epoll); });
+    }
+
+    return _status;
+}
+
+SOCKET_TEMPLATE
+std::unique_ptr<Poller> TcpServer<Socket, T>::_make_poller() const {
+    auto epoll = Poller::create(_poller_type);
+    epoll->set_timeouts(_timeouts);
+    epoll->set_wait_config(_wait_config);
+    epoll->set_client_pool(std::make_unique<ClientPool>(sizeof(T), alignof(T)));
+    return epoll;
+}
+
+SOCKET_TEMPLATE
+typename bstcp::TcpServer<Socket, T>::ServerStatus
+TcpServer<Socket, T>::_init_server_socket(uniq_ptr<Socket> &serv_socket,
+                                          uint16_t type) {
+    serv_socket.reset(new Socket());
+    if (!_inherited.empty()) {
+        auto socket = _inherited.back();
+        _inherited.pop_back();
+        // Options were set by the process that opened it
+        return serv_socket->attach(socket, type) == SocketStatus::connected
+               ? ServerStatus::up : ServerStatus::err_socket_init;
+    }
+
+    switch (serv_socket->init(localhost, _port, type)) {
         case SocketStatus::connected:
             break;
         case SocketStatus::err_socket_bind:
-            return _status = ServerStatus::err_socket_bind;
+            return ServerStatus::err_socket_bind;
         case SocketStatus::err_socket_init:
-            return _status = ServerStatus::err_socket_init;
+            return ServerStatus::err_socket_init;
         case SocketStatus::err_socket_listening:
-            return _status = ServerStatus::err_socket_listening;
+            return ServerStatus::err_socket_listening;
         case SocketStatus::err_socket_connect:
-            return _status = ServerStatus::close;
+            return ServerStatus::close;
         case SocketStatus::disconnected:
-            return _status = ServerStatus::close;
+            return ServerStatus::close;
         case SocketStatus::err_socket_type:
-            return _status = ServerStatus::close;
+            return ServerStatus::close;
         default:
-            return _status = ServerStatus::close;
+            return ServerStatus::close;
     }
-    _epoll.add_server_socket(std::move(serv_socket));
 
-    _status = ServerStatus::up;
-    _thread_pool.add([this] { _waiting_recv_loop(); });
+    // Accepted sockets inherit keep alive options of the listening one
+    if (!_enable_keep_alive(serv_socket->get_socket())) {
+        return ServerStatus::err_scoket_keep_alive;
+    }
 
-    return _status;
+    if (int seconds = (int)_defer_accept.count(); seconds > 0
+        && setsockopt(serv_socket->get_socket(), IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                      &seconds, sizeof(seconds)) == -1) {
+        return ServerStatus::err_socket_listening;
+    }
+    return ServerStatus::up;
 }
 
 SOCKET_TEMPLATE
 void TcpServer<Socket, T>::stop() {
-    _thread_pool.stop();
     _status = ServerStatus::close;
+    _thread_pool.stop();
 
-    _epoll.stop();
+    _epoll->stop();
+    for (auto &epoll: _reactors) {
+        epoll->stop();
+    }
+}
+
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::set_timeouts(const Poller::timeouts_t &timeouts) {
+    _timeouts = timeouts;
+    _epoll->set_timeouts(timeouts);
+    for (auto &epoll: _reactors) {
+        epoll->set_timeouts(timeouts);
+    }
+}
+
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::set_event_loops(size_t count) {
+    _event_loops = count;
+}
+
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::set_wait_config(const Poller::wait_config_t &config) {
+    _wait_config = config;
+}
+
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::set_defer_accept(std::chrono::seconds timeout) {
+    _defer_accept = timeout;
+}
+
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::set_poller(PollerType type) {
+    _poller_type = type;
+}
+
+SOCKET_TEMPLATE
+PollerType TcpServer<Socket, T>::get_poller_type() const {
+    return _reactors.empty() ? _epoll->get_type() : _reactors.front()->get_type();
+}
+
+SOCKET_TEMPLATE
+ClientPool::stats_t TcpServer<Socket, T>::get_client_stats() const {
+    ClientPool::stats_t total;
+    auto add = [&total](const Poller &epoll) {
+        if (epoll.get_client_pool() == nullptr) {
+            return;
+        }
+        auto stats = epoll.get_client_pool()->get_stats();
+        total.slabs += stats.slabs;
+        total.capacity += stats.capacity;
+        total.in_use += stats.in_use;
+        total.peak += stats.peak;
+        total.allocated += stats.allocated;
+    };
+
+    add(*_epoll);
+    for (const auto &epoll: _reactors) {
+        add(*epoll);
+    }
+    return total;
 }
 
 SOCKET_TEMPLATE
@@ -89,6 +223,55 @@ void TcpServer<Socket, T>::joinLoop() {
     _thread_pool.join();
 }
 
+SOCKET_TEMPLATE
+bool TcpServer<Socket, T>::drain(std::chrono::milliseconds timeout) {
+    static constexpr auto check_interval = std::chrono::milliseconds(50);
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        // Repeated, as clients keep finishing requests and become idle
+        _epoll->drain();
+        for (auto &epoll: _reactors) {
+            epoll->drain();
+        }
+
+        if (get_client_stats().in_use == 0) {
+            return true;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(check_interval);
+    }
+}
+
+SOCKET_TEMPLATE
+std::vector<socket_t> TcpServer<Socket, T>::get_listen_sockets() const {
+    std::vector<socket_t> sockets;
+    if (_epoll->get_server()) {
+        sockets.push_back(_epoll->get_server()->get_socket());
+    }
+    for (const auto &epoll: _reactors) {
+        if (epoll->get_server()) {
+            sockets.push_back(epoll->get_server()->get_socket());
+        }
+    }
+    return sockets;
+}
+
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::set_inherited_sockets(std::vector<socket_t> sockets) {
+    _inherited = std::move(sockets);
+}
+
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::_close_inherited() {
+    for (auto socket: _inherited) {
+        close(socket);
+    }
+    _inherited.clear();
+}
+
 SOCKET_TEMPLATE
 bool TcpServer<Socket, T>::connect_to(uint32_t host, uint16_t port,
                                       const _con_handler_function_t &) {
@@ -106,75 +289,149 @@ bool TcpServer<Socket, T>::connect_to(uint32_t host, uint16_t port,
     }
 
    // connect_hndl(client_socket);
-    _epoll.add_client(uniq_ptr<T>(std::move(client_socket)));
+    _epoll->add_client(client_ptr(new T(std::move(*client_socket))));
     return true;
 }
 
 SOCKET_TEMPLATE
 void TcpServer<Socket, T>::disconnect_all() {
-    _epoll.delete_all();
+    _epoll->delete_all();
+    for (auto &epoll: _reactors) {
+        epoll->delete_all();
+    }
 }
 
 SOCKET_TEMPLATE
-void TcpServer<Socket, T>::_accept_loop(const std::unique_ptr<ISocket>& server) {
-    Socket client_socket;
-    if (client_socket.accept(server) == status::connected
-        && _status == ServerStatus::up) {
-
-        if (_enable_keep_alive(client_socket.get_socket())) {
-            uniq_ptr<IServerClient> client(new T(std::move(client_socket)));
-            //_connect_hndl(client);
-            _epoll.add_client(std::move(client));
+void TcpServer<Socket, T>::_accept_loop(Poller &epoll) {
+    // Backlog is drained until it is empty, but within a batch, so
+    // a storm of connections does not hold up events of accepted ones
+    for (size_t i = 0; i < _accept_batch_size; ++i) {
+        auto start = Metrics::now();
+        Socket client_socket;
+        if (client_socket.accept(epoll.get_server()) != status::connected
+            || _status != ServerStatus::up) {
+            return;
         }
+
+        _add_accepted(epoll, std::move(client_socket), start);
     }
 }
 
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::_adopt(Poller &epoll, socket_t socket) {
+    auto start = Metrics::now();
+    Socket client_socket;
+    // Socket is closed with client_socket if it is not served
+    if (client_socket.adopt(socket) != status::connected
+        || _status != ServerStatus::up) {
+        return;
+    }
+    _add_accepted(epoll, std::move(client_socket), start);
+}
+
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::_add_accepted(Poller &epoll, Socket &&client_socket,
+                                         int64_t start) {
+    auto client = epoll.get_client_pool()->template make<T>(
+            std::move(client_socket));
+    //_connect_hndl(client);
+    epoll.add_client(std::move(client));
+    Metrics::add(Counter::accepted_connections);
+    Metrics::record(Histogram::accept_latency, Metrics::now() - start);
+}
+
 SOCKET_TEMPLATE
 void TcpServer<Socket, T>::_waiting_recv_loop() {
-    auto res = _epoll.wait();
-    std::vector<std::function<void(void)>> added_task;
+    // Events are handled before this thread can wait again
+    thread_local std::vector<Poller::epoll_event_t> res;
+    _epoll->wait(res);
+
+    // Next wait goes first: the worker takes its own tasks in reverse
+    // order, so it handles these events while an idle worker steals the loop
+    if (_status == ServerStatus::up) {
+        _thread_pool.add([this]() {
+            _waiting_recv_loop();
+        });
+    }
+
     for (const auto& event : res) {
         auto& client = event.client;
         switch (event.event) {
-            case Epoll::err:
-            case Epoll::event_t::close:
-                _epoll.delete_client(client.get_client());
-                added_task.push_back([this, client] {
-                    client.lock();
-                    client.get_client()->disconnect();
-                    client.unlock();
-                });
+            case Poller::err:
+            case Poller::event_t::close:
+                if (auto owned = _epoll->delete_client(client)) {
+                    owned->disconnect();
+                }
+                break;
+            case Poller::need_accept:
+                _accept_loop(*_epoll);
                 break;
-            case Epoll::need_accept:
-                _accept_loop(_epoll.get_server());
+            case Poller::accepted:
+                _adopt(*_epoll, client.socket);
                 break;
-            case Epoll::can_read:
-                added_task.push_back(
-                    [this, client] {
-                        if (!client.try_lock()) {
-                            return;
-                        }
-                        if (client.get_client()->get_status() !=
-                            SocketStatus::disconnected) {
-                            client.get_client()->handle_request();
-                        }
-                        _epoll.delete_client(client.get_client());
-                        client.get_client()->disconnect();
-                        client.unlock();
+            case Poller::can_read:
+            case Poller::can_write:
+                _thread_pool.add(
+                    [this, client, event = event.event] {
+                        _process_client(*_epoll, client, event);
                     });
                 break;
         }
     }
+}
+
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::_event_loop(Poller &epoll) {
+    // Connections stay in the loop that accepted them and are handled
+    // right in its thread, so loops share neither epoll nor locks
+    std::vector<Poller::epoll_event_t> events;
+    while (_status == ServerStatus::up) {
+        epoll.wait(events);
+        for (const auto& event : events) {
+            auto& client = event.client;
+            switch (event.event) {
+                case Poller::err:
+                case Poller::event_t::close:
+                    if (auto owned = epoll.delete_client(client)) {
+                        owned->disconnect();
+                    }
+                    break;
+                case Poller::need_accept:
+                    _accept_loop(epoll);
+                    break;
+                case Poller::accepted:
+                    _adopt(epoll, client.socket);
+                    break;
+                case Poller::can_read:
+                case Poller::can_write:
+                    _process_client(epoll, client, event.event);
+                    break;
+            }
+        }
+    }
+}
 
+SOCKET_TEMPLATE
+void TcpServer<Socket, T>::_process_client(Poller &epoll,
+                                           const Poller::Client &client,
+                                           Poller::event_t event) {
+    // Client is owned here until it is rearmed, no other event can come
+    auto sts = HandleStatus::done;
+    if (client.client->get_status() != SocketStatus::disconnected) {
+        sts = event == Poller::can_write
+                ? client.client->handle_write()
+                : client.client->handle_request();
+    }
 
-    if (_status == ServerStatus::up) {
-        added_task.push_back([this]() {
-            _waiting_recv_loop();
-        });
+    if (sts == HandleStatus::need_write || sts == HandleStatus::keep_alive) {
+        if (epoll.rearm_client(client, sts == HandleStatus::need_write
+                                       ? Poller::can_write : Poller::can_read)) {
+            return;
+        }
     }
 
-    if (!added_task.empty()) {
-        _thread_pool.add_multi(added_task);
+    if (auto owned = epoll.delete_client(client)) {
+        owned->disconnect();
     }
 }
 
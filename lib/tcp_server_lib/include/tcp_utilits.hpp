@@ -5,6 +5,7 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -43,6 +44,7 @@ enum class SocketType : uint16_t {
     server_socket       = 2,
     blocking_socket     = 4,
     nonblocking_socket  = 8,
+    reuse_port          = 16,
 };
 
 enum class SocketStatus : uint8_t {
@@ -65,7 +67,9 @@ class IReceivable {
   public:
     virtual ~IReceivable() = default;
 
-    virtual bool recv_from(void *buffer, int size) = 0;
+    // Returns number of received bytes, 0 if there is no data yet,
+    // -1 on error or when the peer has closed the connection
+    virtual ssize_t recv_from(void *buffer, size_t size) = 0;
 };
 
 class ISendable {
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "task.hpp"
+
+namespace prll {
+
+// Chase-Lev deque: the owner thread pushes and takes from the bottom
+// without locks, other threads steal from the top.
+class WorkStealingDeque {
+  public:
+    explicit WorkStealingDeque(size_t capacity = 256);
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque operator=(const WorkStealingDeque&) = delete;
+
+    ~WorkStealingDeque();
+
+    // Owner only
+    void push(Task *task);
+
+    // Owner only, nullptr if empty
+    Task *take();
+
+    // Any thread, nullptr if empty or lost race to other thread
+    Task *steal();
+
+    [[nodiscard]] bool empty() const;
+
+  private:
+    struct Array {
+        explicit Array(size_t capacity);
+
+        [[nodiscard]] Task *get(int64_t index) const;
+
+        void put(int64_t index, Task *task);
+
+        [[nodiscard]] Array *grow(int64_t top, int64_t bottom) const;
+
+        size_t                                  capacity;
+        std::unique_ptr<std::atomic<Task *>[]>  items;
+    };
+
+    alignas(64) std::atomic<int64_t>    _top;
+    alignas(64) std::atomic<int64_t>    _bottom;
+    std::atomic<Array *>                _array;
+
+    // Thieves may still read old arrays, so they live until destruction
+    std::vector<std::unique_ptr<Array>> _retired;
+};
+
+}
@@ -0,0 +1,77 @@
+#include "client_pool.hpp"
+
+#include <algorithm>
+#include <new>
+
+namespace bstcp {
+
+void ClientDeleter::operator()(IServerClient *client) const {
+    if (pool == nullptr) {
+        delete client;
+        return;
+    }
+    // Slot starts at the most derived object
+    auto *slot = dynamic_cast<void *>(client);
+    client->~IServerClient();
+    pool->deallocate(slot);
+}
+
+static size_t slot_size(size_t object_size, size_t alignment) {
+    auto size = std::max(object_size, sizeof(void *));
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+ClientPool::ClientPool(size_t object_size, size_t alignment,
+                       size_t slab_objects)
+    : _slot_size(slot_size(object_size, std::max(alignment, alignof(void *))))
+    , _alignment(std::max(alignment, alignof(void *)))
+    , _slab_objects(std::max<size_t>(slab_objects, 1)) {}
+
+ClientPool::~ClientPool() {
+    for (auto *slab: _slabs) {
+        ::operator delete(slab, std::align_val_t(_alignment));
+    }
+}
+
+void ClientPool::_add_slab() {
+    auto *slab = static_cast<char *>(
+            ::operator new(_slot_size * _slab_objects, std::align_val_t(_alignment)));
+    _slabs.push_back(slab);
+
+    for (size_t i = _slab_objects; i > 0; --i) {
+        auto *slot = reinterpret_cast<free_slot_t *>(slab + (i - 1) * _slot_size);
+        slot->next = _free;
+        _free = slot;
+    }
+    ++_stats.slabs;
+    _stats.capacity += _slab_objects;
+}
+
+void *ClientPool::allocate() {
+    std::lock_guard lock(_mutex);
+    if (_free == nullptr) {
+        _add_slab();
+    }
+
+    auto *slot = _free;
+    _free = slot->next;
+
+    ++_stats.allocated;
+    _stats.peak = std::max(_stats.peak, ++_stats.in_use);
+    return slot;
+}
+
+void ClientPool::deallocate(void *slot) {
+    std::lock_guard lock(_mutex);
+    auto *free_slot = static_cast<free_slot_t *>(slot);
+    free_slot->next = _free;
+    _free = free_slot;
+    --_stats.in_use;
+}
+
+ClientPool::stats_t ClientPool::get_stats() const {
+    std::lock_guard lock(_mutex);
+    return _stats;
+}
+
+}
@@ -0,0 +1,175 @@
+#include "connection.hpp"
+
+#include <sys/socket.h>
+
+#include "metrics.hpp"
+#include "poller.hpp"
+
+namespace bstcp {
+
+// Free space requested before each read and limit of unprocessed input
+static const size_t min_read_size = 2048;
+static const size_t max_input_size = 64 * 1024;
+// Discarded input is read through a buffer on the stack
+static const size_t discard_size = 4096;
+
+Connection::Connection(BaseSocket &&socket)
+        : _socket(std::move(socket)) {}
+
+Connection::Awaiter Connection::read() {
+    return {*this, Wait::read};
+}
+
+Connection::Awaiter Connection::flush() {
+    return {*this, Wait::write};
+}
+
+Connection::Awaiter Connection::linger() {
+    return {*this, Wait::linger};
+}
+
+Connection::Awaiter Connection::write(std::string data) {
+    _output.push(std::move(data));
+    return flush();
+}
+
+Connection::Awaiter Connection::write(std::string_view data,
+                                      std::shared_ptr<const void> owner) {
+    _output.push(data, std::move(owner));
+    return flush();
+}
+
+Connection::Awaiter Connection::sendfile(FileRange range) {
+    _output.push(std::move(range));
+    return flush();
+}
+
+RecvBuffer &Connection::input() {
+    return _input;
+}
+
+OutputQueue &Connection::output() {
+    return _output;
+}
+
+BaseSocket &Connection::socket() {
+    return _socket;
+}
+
+const BaseSocket &Connection::socket() const {
+    return _socket;
+}
+
+Connection::Wait Connection::get_wait() const {
+    return _wait;
+}
+
+Timeout Connection::get_timeout(int64_t &since) const {
+    since = _since;
+    return _timeout;
+}
+
+bool Connection::ready() {
+    if (!_try(_wait)) {
+        // Socket became writable, so the peer has taken a part of output
+        if (_wait == Wait::write) {
+            _since = Poller::now();
+        }
+        return false;
+    }
+    _wait = Wait::none;
+    return true;
+}
+
+bool Connection::_try(Wait wait) {
+    switch (wait) {
+        case Wait::read:
+            return _read();
+        case Wait::write:
+            return _flush();
+        case Wait::linger:
+            return _discard();
+        case Wait::none:
+            break;
+    }
+    return true;
+}
+
+void Connection::_suspend(Wait wait) {
+    _wait = wait;
+
+    auto timeout = Timeout::write;
+    if (wait == Wait::read) {
+        timeout = _input.empty() ? Timeout::idle : Timeout::header;
+    } else if (wait == Wait::linger) {
+        timeout = Timeout::linger;
+    }
+    // Write limit is for a stall, so it restarts after every sent part;
+    // others count from the first wait for the same request
+    auto consumed = _input.get_consumed();
+    if (timeout != _timeout || timeout == Timeout::write || consumed != _consumed) {
+        _since = Poller::now();
+    }
+    _timeout = timeout;
+    _consumed = consumed;
+
+    // Waiting connection holds no receive buffer unless it has unread data
+    _input.release();
+}
+
+bool Connection::_read() {
+    // Edge triggered socket is read until it has no data, otherwise
+    // the rest of input would never be reported again
+    bool received = false;
+    while (_input.size() < max_input_size) {
+        auto *tail = _input.prepare(min_read_size);
+        auto size = _socket.recv_from(tail, _input.space());
+        if (size == 0) {
+            break;
+        }
+        if (size < 0) {
+            _result = false;
+            return true;
+        }
+        _input.commit(size);
+        received = true;
+    }
+    _result = true;
+    return received || _input.size() >= max_input_size;
+}
+
+bool Connection::_discard() {
+    if (!_write_shut) {
+        _write_shut = true;
+        shutdown(_socket.get_socket(), SHUT_WR);
+        _input.consume(_input.size());
+    }
+
+    char buffer[discard_size];
+    while (true) {
+        auto size = _socket.recv_from(buffer, sizeof(buffer));
+        if (size == 0) {
+            return false;
+        }
+        if (size < 0) {
+            // End of input or an error, either way nothing is left to reset
+            _result = true;
+            return true;
+        }
+    }
+}
+
+bool Connection::_flush() {
+    if (_output.empty()) {
+        _result = true;
+        return true;
+    }
+
+    auto start = Metrics::now();
+    auto sent = _output.flush(_socket);
+    Metrics::record(Histogram::send_time, Metrics::now() - start);
+    _result = sent != TransferStatus::error;
+    return sent != TransferStatus::would_block;
+}
+
+}
@@ -0,0 +1,298 @@
+#include "connection_table.hpp"
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace bstcp {
+
+static const uint32_t generation_mask = (1u << 30) - 1;
+static const size_t min_sockets = 1024;
+static const size_t max_sockets = 1u << 24;
+
+ConnectionTable::ConnectionTable()
+    : _chunks_count(0)
+    , _max_socket(-1)
+    , _current(_tick(now())) {
+    // Only pointers to chunks are allocated up front, even for a large limit
+    size_t limit = max_sockets;
+    struct rlimit rlim{};
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_max != RLIM_INFINITY) {
+        limit = std::clamp((size_t)rlim.rlim_max, min_sockets, max_sockets);
+    }
+
+    _chunks_count = (limit + chunk_size - 1) / chunk_size;
+    _chunks.reset(new std::atomic<slot_t *>[_chunks_count]);
+    for (size_t i = 0; i < _chunks_count; ++i) {
+        _chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ConnectionTable::~ConnectionTable() {
+    for (size_t i = 0; i < _chunks_count; ++i) {
+        auto *chunk = _chunks[i].load(std::memory_order_acquire);
+        if (chunk == nullptr) {
+            continue;
+        }
+        for (size_t j = 0; j < chunk_size; ++j) {
+            if (chunk[j].client != nullptr) {
+                ClientDeleter{chunk[j].pool}(chunk[j].client);
+            }
+        }
+        delete[] chunk;
+    }
+}
+
+uint64_t ConnectionTable::key(const entry_t &entry) {
+    return (uint64_t)entry.generation << 32 | (uint32_t)entry.socket;
+}
+
+int64_t ConnectionTable::now() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count() + 1;
+}
+
+uint64_t ConnectionTable::_tag(uint32_t generation, state_t state) {
+    return (uint64_t)generation << 8 | state;
+}
+
+ConnectionTable::slot_t *ConnectionTable::_find(socket_t socket) const {
+    if (socket < 0 || (size_t)socket / chunk_size >= _chunks_count) {
+        return nullptr;
+    }
+    auto *chunk = _chunks[socket / chunk_size].load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+        return nullptr;
+    }
+    return &chunk[socket % chunk_size];
+}
+
+ConnectionTable::slot_t *ConnectionTable::_get(socket_t socket) {
+    if (socket < 0 || (size_t)socket / chunk_size >= _chunks_count) {
+        return nullptr;
+    }
+
+    auto &chunk = _chunks[socket / chunk_size];
+    auto *slots = chunk.load(std::memory_order_acquire);
+    if (slots == nullptr) {
+        // Chunks are never freed before the table, so the loser of
+        // the race just drops its own
+        auto *allocated = new slot_t[chunk_size];
+        if (chunk.compare_exchange_strong(slots, allocated,
+                                          std::memory_order_acq_rel)) {
+            slots = allocated;
+        } else {
+            delete[] allocated;
+        }
+    }
+
+    auto max_socket = _max_socket.load(std::memory_order_relaxed);
+    while (max_socket < socket
+           && !_max_socket.compare_exchange_weak(max_socket, socket,
+                                                 std::memory_order_release)) {}
+    return &slots[socket % chunk_size];
+}
+
+// Sequentially consistent, as arm and the wheel check each other's
+// store to the tag and to the due tick of a slot
+bool ConnectionTable::_transit(slot_t &slot, uint32_t generation,
+                               state_t from, state_t to) {
+    auto expected = _tag(generation, from);
+    return slot.tag.compare_exchange_strong(expected, _tag(generation, to));
+}
+
+ConnectionTable::entry_t ConnectionTable::_entry(const slot_t &slot,
+                                                 socket_t socket) const {
+    entry_t entry;
+    entry.client = slot.client;
+    entry.socket = socket;
+    entry.generation = (uint32_t)(slot.tag.load(std::memory_order_relaxed) >> 8);
+    return entry;
+}
+
+bool ConnectionTable::add(client_ptr &&client, entry_t &entry) {
+    auto socket = client->get_socket();
+    auto *slot = _get(socket);
+    if (slot == nullptr) {
+        return false;
+    }
+
+    // Previous client of the socket is removed before the socket is
+    // closed, so the slot of an open socket is free. Acquire pairs with
+    // the release in remove made by the thread that closed the socket
+    auto generation = (uint32_t)(slot->tag.load(std::memory_order_acquire) >> 8);
+    generation = (generation + 1) & generation_mask;
+    slot->pool = client.get_deleter().pool;
+    slot->client = client.release();
+    slot->socket = socket;
+    slot->deadline.store(0, std::memory_order_relaxed);
+    slot->tag.store(_tag(generation, busy), std::memory_order_release);
+
+    entry = _entry(*slot, socket);
+    return true;
+}
+
+bool ConnectionTable::acquire(uint64_t key, entry_t &entry) {
+    auto socket = (socket_t)(uint32_t)key;
+    auto generation = (uint32_t)(key >> 32);
+    auto *slot = _find(socket);
+    if (slot == nullptr || !_transit(*slot, generation, armed, busy)) {
+        return false;
+    }
+    entry = _entry(*slot, socket);
+    return true;
+}
+
+bool ConnectionTable::arm(const entry_t &entry, int64_t deadline, Timeout timeout) {
+    auto *slot = _find(entry.socket);
+    if (slot == nullptr) {
+        return false;
+    }
+    slot->deadline.store(deadline, std::memory_order_relaxed);
+    slot->timeout.store(timeout, std::memory_order_relaxed);
+    if (!_transit(*slot, entry.generation, busy, armed)) {
+        return false;
+    }
+
+    // Slot in a bucket due before the deadline is moved when it is due.
+    // Otherwise the wheel has unlinked it after seeing it busy, then
+    // it is linked here, or the wheel sees it armed and links it itself
+    auto due = slot->due.load();
+    if (deadline != 0 && (due == unlinked || due > _tick(deadline))) {
+        std::lock_guard lock(_wheel_mutex);
+        _link(*slot, _tick(deadline));
+    }
+    return true;
+}
+
+bool ConnectionTable::disarm(const entry_t &entry) {
+    auto *slot = _find(entry.socket);
+    return slot != nullptr && _transit(*slot, entry.generation, armed, busy);
+}
+
+client_ptr ConnectionTable::remove(const entry_t &entry, bool &was_armed) {
+    was_armed = false;
+    auto *slot = _find(entry.socket);
+    if (slot == nullptr) {
+        return nullptr;
+    }
+
+    auto tag = slot->tag.load(std::memory_order_acquire);
+    if (tag != _tag(entry.generation, busy)
+        && tag != _tag(entry.generation, closing)) {
+        return nullptr;
+    }
+    was_armed = (tag & 0xff) == closing;
+
+    client_ptr client(slot->client, ClientDeleter{slot->pool});
+    slot->client = nullptr;
+    slot->pool = nullptr;
+    slot->tag.store(_tag(entry.generation, free), std::memory_order_release);
+    return client;
+}
+
+int64_t ConnectionTable::_tick(int64_t time) {
+    // Deadline within a tick is due at its end
+    return (time + tick_ms - 1) / tick_ms;
+}
+
+void ConnectionTable::_link(slot_t &slot, int64_t tick) {
+    _unlink(slot);
+
+    tick = std::max(tick, _current);
+    slot_t **bucket;
+    int64_t due;
+    if (tick - _current < (int64_t)near_buckets) {
+        bucket = &_near[tick % near_buckets];
+        due = tick;
+    } else {
+        // Far bucket is due at the start of its turn and moves slots to
+        // near ones, later deadlines wait in the last one
+        auto turn = std::min(tick / (int64_t)near_buckets,
+                             _current / (int64_t)near_buckets + (int64_t)far_buckets - 1);
+        bucket = &_far[turn % far_buckets];
+        due = turn * (int64_t)near_buckets;
+    }
+
+    slot.next = *bucket;
+    if (slot.next != nullptr) {
+        slot.next->prev = &slot.next;
+    }
+    slot.prev = bucket;
+    *bucket = &slot;
+    slot.due.store(due);
+}
+
+void ConnectionTable::_unlink(slot_t &slot) {
+    if (slot.prev == nullptr) {
+        return;
+    }
+    *slot.prev = slot.next;
+    if (slot.next != nullptr) {
+        slot.next->prev = slot.prev;
+    }
+    slot.next = nullptr;
+    slot.prev = nullptr;
+}
+
+void ConnectionTable::expire(int64_t now, std::vector<expired_t> &expired) {
+    std::lock_guard lock(_wheel_mutex);
+    for (auto tick = now / tick_ms; _current <= tick; ++_current) {
+        if (_current % (int64_t)near_buckets == 0) {
+            auto &far = _far[(_current / (int64_t)near_buckets) % far_buckets];
+            _expire_bucket(std::exchange(far, nullptr), now, expired);
+        }
+        _expire_bucket(std::exchange(_near[_current % near_buckets], nullptr),
+                       now, expired);
+    }
+}
+
+void ConnectionTable::_expire_bucket(slot_t *bucket, int64_t now,
+                                     std::vector<expired_t> &expired) {
+    while (bucket != nullptr) {
+        auto &slot = *bucket;
+        bucket = slot.next;
+        slot.next = nullptr;
+        slot.prev = nullptr;
+        slot.due.store(unlinked);
+
+        // Taken or removed client is linked again when it is armed
+        auto tag = slot.tag.load();
+        auto deadline = slot.deadline.load(std::memory_order_relaxed);
+        if ((tag & 0xff) != armed || deadline == 0) {
+            continue;
+        }
+        if (deadline > now) {
+            _link(slot, _tick(deadline));
+            continue;
+        }
+
+        if (_transit(slot, (uint32_t)(tag >> 8), armed, closing)) {
+            expired.push_back({_entry(slot, slot.socket),
+                               slot.timeout.load(std::memory_order_relaxed)});
+        }
+    }
+}
+
+void ConnectionTable::expire_all(Timeout timeout, std::vector<expired_t> &expired) {
+    auto max_socket = _max_socket.load(std::memory_order_acquire);
+    for (socket_t socket = 0; socket <= max_socket; ++socket) {
+        auto *slot = _find(socket);
+        if (slot == nullptr) {
+            socket |= (socket_t)(chunk_size - 1);
+            continue;
+        }
+
+        auto tag = slot->tag.load();
+        if ((tag & 0xff) != armed
+            || slot->timeout.load(std::memory_order_relaxed) != timeout) {
+            continue;
+        }
+        if (_transit(*slot, (uint32_t)(tag >> 8), armed, closing)) {
+            expired.push_back({_entry(*slot, socket), timeout});
+        }
+    }
+}
+
+}
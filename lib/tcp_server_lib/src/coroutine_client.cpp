@@ -0,0 +1,97 @@
+#include "coroutine_client.hpp"
+
+#include "metrics.hpp"
+
+namespace bstcp {
+
+CoroutineClient::CoroutineClient(BaseSocket &&socket)
+        : _connection(std::move(socket)) {}
+
+// Frame of a started session refers to the moved client, so it stays
+CoroutineClient::CoroutineClient(CoroutineClient &&client) noexcept
+        : _connection(std::move(client._connection)) {}
+
+HandleStatus CoroutineClient::handle_request() {
+    return _resume();
+}
+
+HandleStatus CoroutineClient::handle_write() {
+    return _resume();
+}
+
+HandleStatus CoroutineClient::_resume() {
+    if (!_session) {
+        _session = serve();
+    } else if (!_connection.ready()) {
+        // Spurious event, the operation still can not complete
+        return _wait_status();
+    }
+
+    _session.resume();
+    if (!_session.done()) {
+        return _wait_status();
+    }
+    if (_session.error()) {
+        Metrics::add(Counter::session_errors);
+    }
+    return HandleStatus::done;
+}
+
+HandleStatus CoroutineClient::_wait_status() const {
+    return _connection.get_wait() == Connection::Wait::write
+           ? HandleStatus::need_write : HandleStatus::keep_alive;
+}
+
+uint32_t CoroutineClient::get_host() const {
+    return _connection.socket().get_host();
+}
+
+uint16_t CoroutineClient::get_port() const {
+    return _connection.socket().get_port();
+}
+
+SocketStatus CoroutineClient::get_status() const {
+    return _connection.socket().get_status();
+}
+
+SocketStatus CoroutineClient::disconnect() {
+    return _connection.socket().disconnect();
+}
+
+ssize_t CoroutineClient::recv_from(void *buffer, size_t size) {
+    return _connection.socket().recv_from(buffer, size);
+}
+
+bool CoroutineClient::send_to(const void *buffer, int size) const {
+    return _connection.socket().send_to(buffer, size);
+}
+
+SocketType CoroutineClient::get_type() const {
+    return SocketType::client_socket;
+}
+
+socket_t CoroutineClient::get_socket() {
+    return _connection.socket().get_socket();
+}
+
+bool CoroutineClient::is_allow_to_read(long timeout) const {
+    return _connection.socket().is_allow_to_read(timeout);
+}
+
+bool CoroutineClient::is_allow_to_write(long timeout) const {
+    return _connection.socket().is_allow_to_write(timeout);
+}
+
+bool CoroutineClient::is_allow_to_rwrite(long timeout) const {
+    return _connection.socket().is_allow_to_rwrite(timeout);
+}
+
+Timeout CoroutineClient::get_timeout(int64_t &since) const {
+    return _connection.get_timeout(since);
+}
+
+status CoroutineClient::accept(const std::unique_ptr<ISocket> &server_socket) {
+    return _connection.socket().accept(server_socket);
+}
+
+}
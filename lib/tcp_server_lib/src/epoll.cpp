@@ -1,4 +1,6 @@
 #include <sys/epoll.h>
+#include <algorithm>
+#include <chrono>
 #include <exception>
 #include <iostream>
 
@@ -6,22 +8,32 @@
 
 namespace bstcp {
 
-const size_t timeout    = 1000;
+// Smallest batch of adaptive waits
+const size_t min_adaptive_events = 16;
+
+// Registrations of clients never have the top bits set
+const uint64_t server_data = ~0ull;
 
 Epoll::Epoll()
-    : _epoll_fd(epoll_create1(0)) {}
+    : _epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {}
 
-bool Epoll::delete_client(const std::shared_ptr<IServerClient>& client) {
-    auto socket_fd = client->get_socket();
-    std::lock_guard lock(_mutex);
-    if (_clients.find(socket_fd) == _clients.end()) {
-        return false;
+Epoll::~Epoll() {
+    if (_epoll_fd != -1) {
+        ::close(_epoll_fd);
     }
-    _clients.erase(socket_fd);
-    if (epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, client->get_socket(), nullptr) == -1) {
-        return false;
+}
+
+PollerType Epoll::get_type() const {
+    return PollerType::epoll;
+}
+
+client_ptr Epoll::delete_client(const Client &client) {
+    bool was_armed;
+    auto owned = _clients.remove(client, was_armed);
+    if (owned) {
+        _delete_ctl(client.socket);
     }
-    return true;
+    return owned;
 }
 
 bool Epoll::_delete_ctl(socket_t socket) const {
@@ -31,61 +43,118 @@ bool Epoll::_delete_ctl(socket_t socket) const {
     return true;
 }
 
-std::vector<Epoll::epoll_event_t> Epoll::wait() {
+int Epoll::_wait_events(std::vector<struct epoll_event> &events, size_t batch) {
+    // Thread that has just handled events polls for a while instead of
+    // sleeping, as under load next events come within microseconds
+    thread_local bool had_events = false;
+    int number = 0;
+    if (had_events && _wait_config.busy_poll.count() > 0) {
+        auto deadline = std::chrono::steady_clock::now() + _wait_config.busy_poll;
+        do {
+            number = epoll_wait(_epoll_fd, events.data(), (int)batch, 0);
+        } while (number == 0 && std::chrono::steady_clock::now() < deadline);
+    }
+    if (number <= 0) {
+        number = epoll_wait(_epoll_fd, events.data(), (int)batch,
+                            (int)_wait_config.timeout.count());
+    }
+    had_events = number > 0;
+    return number;
+}
+
+void Epoll::wait(std::vector<epoll_event_t> &selected) {
+    selected.clear();
     if (!_serv_socket) {
-        return {};
+        return;
     }
 
-    std::vector<struct epoll_event> events(number_events);
+    // Every thread is in one wait at a time, so it keeps own buffer
+    // and size of adaptive batch
+    thread_local std::vector<struct epoll_event> events;
+    thread_local size_t adaptive_batch = min_adaptive_events;
+
+    auto max_events = std::max<size_t>(_wait_config.max_events, 1);
+    auto batch = _wait_config.adaptive
+                 ? std::clamp(adaptive_batch, std::min(min_adaptive_events, max_events),
+                              max_events)
+                 : max_events;
+    if (events.size() < batch) {
+        events.resize(batch);
+    }
 
-    auto number = epoll_wait(_epoll_fd, events.data(), number_events, timeout);
-    std::vector<epoll_event_t> selected;
+    auto number = _wait_events(events, batch);
+    if (_wait_config.adaptive && number == (int)batch) {
+        adaptive_batch = batch * 2;
+    } else if (_wait_config.adaptive && number < (int)batch / 4) {
+        adaptive_batch = batch / 2;
+    }
 
-    std::lock_guard lock(_mutex);
     for (int i = 0; i < number; ++i) {
         epoll_event_t epollEvent;
 
-        if (events[i].data.fd != _serv_socket->get_socket()
-        && _clients.find(events[i].data.fd) == _clients.end()) {
-            _delete_ctl(events[i].data.fd);
+        if (events[i].data.u64 == server_data) {
+            if (events[i].events & EPOLLIN) {
+                epollEvent.event = event_t::need_accept;
+                selected.push_back(epollEvent);
+            }
+            continue;
+        }
+
+        // Client is gone or expired while the event was on the way
+        if (!_clients.acquire(events[i].data.u64, epollEvent.client)) {
             continue;
         }
 
-        if (events[i].events & EPOLLHUP || events[i].events & EPOLLRDHUP) {
+        // Data sent before the peer closed its side is read first,
+        // the client sees end of stream after it
+        if (events[i].events & EPOLLHUP
+            || (events[i].events & EPOLLRDHUP && !(events[i].events & EPOLLIN))) {
             epollEvent.event = event_t::close;
         } else if (events[i].events & EPOLLIN) {
-             if(events[i].data.fd == _serv_socket->get_socket()) {
-                 epollEvent.event = event_t::need_accept;
-                 selected.push_back(epollEvent);
-                 continue;
-             } else {
-                 epollEvent.event = event_t::can_read;
-             }
-         } else {
+            epollEvent.event = event_t::can_read;
+        } else if (events[i].events & EPOLLOUT) {
+            epollEvent.event = event_t::can_write;
+        } else {
             epollEvent.event = event_t::err;
         }
-        epollEvent.client = _clients[events[i].data.fd];
 
         selected.push_back(epollEvent);
     }
 
-    return selected;
+    _expire(selected);
+}
+
+bool Epoll::add_client(client_ptr&& client) {
+    Client added;
+    if (!_clients.add(std::move(client), added)) {
+        return false;
+    }
+
+    if (!_arm(added, EPOLL_CTL_ADD, event_t::can_read)) {
+        bool was_armed;
+        _clients.remove(added, was_armed);
+        return false;
+    }
+    return true;
+}
+
+bool Epoll::rearm_client(const Client &client, event_t event) {
+    return _arm(client, EPOLL_CTL_MOD, event);
 }
 
-bool Epoll::add_client(std::unique_ptr<IServerClient>&& client) {
+bool Epoll::_arm(const Client &client, int operation, event_t event) {
     struct epoll_event ev{};
-    auto socket_fd = client->get_socket();
-    ev.data.fd = socket_fd;
-    ev.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+    ev.data.u64 = ConnectionTable::key(client);
+    ev.events = EPOLLET | EPOLLRDHUP | EPOLLONESHOT
+                | (event == event_t::can_write ? EPOLLOUT : EPOLLIN);
 
-    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, client->get_socket(), &ev) ==
-        -1) {
+    // Slot is armed first, the event may come right after epoll_ctl
+    if (!_give_back(client, event)) {
         return false;
     }
-    {
-        std::lock_guard lock(_mutex);
-        _clients[socket_fd] = Client(
-                std::shared_ptr<IServerClient>(client.release()));
+    if (epoll_ctl(_epoll_fd, operation, client.socket, &ev) == -1) {
+        // Otherwise the client expired meanwhile and is closed by its event
+        return !_clients.disarm(client);
     }
     return true;
 }
@@ -93,7 +162,7 @@ bool Epoll::add_client(std::unique_ptr<IServerClient>&& client) {
 bool Epoll::add_server_socket(std::unique_ptr<ISocket> server) {
     _serv_socket = std::move(server);
     struct epoll_event ev{};
-    ev.data.fd = _serv_socket->get_socket();
+    ev.data.u64 = server_data;
     ev.events = EPOLLIN;
 
     if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _serv_socket->get_socket(), &ev) == -1) {
@@ -102,61 +171,23 @@ bool Epoll::add_server_socket(std::unique_ptr<ISocket> server) {
     return true;
 }
 
-void Epoll::stop() {
-    std::lock_guard lock(_mutex);
-    _serv_socket->disconnect();
-    _serv_socket = nullptr;
-
-    for(auto& client : _clients) {
-        _delete_ctl(client.second.get_client()->get_socket());
-    }
-
-    _clients.clear();
-}
-
-std::vector<Epoll::Client> Epoll::get_clients() {
-    std::vector<Client> res;
-    for (const auto& client: _clients) {
-        res.push_back(client.second);
-    }
-    return res;
+void Epoll::_stop_listening() {
+    _delete_ctl(_serv_socket->get_socket());
 }
 
-void Epoll::delete_all() {
-    std::lock_guard lock(_mutex);
-    for(auto& client : _clients) {
-        _delete_ctl(client.second.get_client()->get_socket());
+void Epoll::stop() {
+    if (_serv_socket) {
+        _serv_socket->disconnect();
+        _serv_socket = nullptr;
     }
 
-    _clients.clear();
-}
-
-Epoll::Client::Client(std::shared_ptr<IServerClient>&& client)
-    : _access_mtx(new std::mutex())
-    , _client(std::move(client)){}
-
-bool Epoll::Client::try_lock() const {
-    return _access_mtx->try_lock();
-}
-
-void Epoll::Client::lock() const {
-    _access_mtx->lock();
+    delete_all();
 }
 
-const std::shared_ptr<IServerClient>& Epoll::Client::get_client() const{
-    return _client;
+void Epoll::delete_all() {
+    _clients.clear([this](const Client &client) {
+        _delete_ctl(client.socket);
+    });
 }
 
-void Epoll::Client::unlock() const {
-    _access_mtx->unlock();
 }
-
-Epoll::Client::Client()
-    : _access_mtx(new std::mutex())
-    , _client(){}
-
-const std::unique_ptr<ISocket> &Epoll::get_server() const {
-    return _serv_socket;
-}
-
-}
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "file_range.hpp"
+
+#include <sys/sendfile.h>
+#include <algorithm>
+#include <cerrno>
+
+namespace bstcp {
+
+static const size_t max_sendfile_chunk = 0x7ffff000;
+static const size_t max_splice_chunk = 1 << 16;
+
+FileRange::FileRange(int file_fd, off_t offset, size_t size)
+        : _file_fd(file_fd)
+        , _offset(offset)
+        , _remain(size) {}
+
+FileRange::FileRange(FileRange &&range) noexcept
+        : _file_fd(range._file_fd)
+        , _offset(range._offset)
+        , _remain(range._remain)
+        , _use_splice(range._use_splice)
+        , _pipe{range._pipe[0], range._pipe[1]}
+        , _in_pipe(range._in_pipe) {
+    range._file_fd = -1;
+    range._pipe[0] = range._pipe[1] = -1;
+    range._remain = range._in_pipe = 0;
+}
+
+FileRange &FileRange::operator=(FileRange &&range) noexcept {
+    if (this == &range) {
+        return *this;
+    }
+    reset();
+
+    _file_fd    = range._file_fd;
+    _offset     = range._offset;
+    _remain     = range._remain;
+    _use_splice = range._use_splice;
+    _pipe[0]    = range._pipe[0];
+    _pipe[1]    = range._pipe[1];
+    _in_pipe    = range._in_pipe;
+
+    range._file_fd = -1;
+    range._pipe[0] = range._pipe[1] = -1;
+    range._remain = range._in_pipe = 0;
+    return *this;
+}
+
+FileRange::~FileRange() {
+    reset();
+}
+
+void FileRange::reset() {
+    if (_file_fd != -1) {
+        close(_file_fd);
+        _file_fd = -1;
+    }
+    if (_pipe[0] != -1) {
+        close(_pipe[0]);
+        close(_pipe[1]);
+        _pipe[0] = _pipe[1] = -1;
+    }
+    _offset = 0;
+    _remain = 0;
+    _in_pipe = 0;
+    _use_splice = false;
+}
+
+bool FileRange::empty() const {
+    return _remain == 0 && _in_pipe == 0;
+}
+
+size_t FileRange::size() const {
+    return _remain + _in_pipe;
+}
+
+TransferStatus FileRange::send_to(socket_t socket) {
+    if (_use_splice) {
+        return _splice(socket);
+    }
+    return _sendfile(socket);
+}
+
+TransferStatus FileRange::_sendfile(socket_t socket) {
+    while (_remain > 0) {
+        auto sent = sendfile(socket, _file_fd, &_offset,
+                             std::min(_remain, max_sendfile_chunk));
+        if (sent > 0) {
+            _remain -= sent;
+            continue;
+        }
+        if (sent == 0) {
+            // File was truncated after the headers were sent
+            return TransferStatus::error;
+        }
+
+        switch (errno) {
+            case EINTR:
+                continue;
+            case EAGAIN:
+                return TransferStatus::would_block;
+            case EINVAL:
+            case ENOSYS:
+                _use_splice = true;
+                return _splice(socket);
+            default:
+                return TransferStatus::error;
+        }
+    }
+    return TransferStatus::done;
+}
+
+TransferStatus FileRange::_splice(socket_t socket) {
+    if (_pipe[0] == -1 && pipe2(_pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+        return TransferStatus::error;
+    }
+
+    while (_remain > 0 || _in_pipe > 0) {
+        if (_in_pipe == 0) {
+            auto got = splice(_file_fd, &_offset, _pipe[1], nullptr,
+                              std::min(_remain, max_splice_chunk),
+                              SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (got == 0) {
+                return TransferStatus::error;
+            }
+            if (got < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return TransferStatus::error;
+            }
+            _remain -= got;
+            _in_pipe = got;
+        }
+
+        auto sent = splice(_pipe[0], nullptr, socket, nullptr, _in_pipe,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+                           | (_remain > 0 ? SPLICE_F_MORE : 0));
+        if (sent > 0) {
+            _in_pipe -= sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && errno == EAGAIN) {
+            return TransferStatus::would_block;
+        }
+        return TransferStatus::error;
+    }
+    return TransferStatus::done;
+}
+
+}
@@ -0,0 +1,59 @@
+#include "frame_pool.hpp"
+
+#include <array>
+#include <new>
+#include <utility>
+
+namespace bstcp {
+
+static constexpr size_t classes_count = FramePool::max_slot_size / FramePool::slot_step;
+
+// Free slots are linked through their first bytes
+struct FramePool::local_t {
+    struct slot_t {
+        slot_t *next;
+    };
+
+    std::array<slot_t *, classes_count> free{};
+    std::array<size_t, classes_count>   counts{};
+
+    ~local_t() {
+        for (auto *slot: free) {
+            while (slot != nullptr) {
+                ::operator delete(std::exchange(slot, slot->next));
+            }
+        }
+    }
+};
+
+thread_local FramePool::local_t FramePool::_local;
+
+void *FramePool::allocate(size_t size) {
+    if (size == 0 || size > max_slot_size) {
+        return ::operator new(size);
+    }
+    auto index = (size - 1) / slot_step;
+    auto *slot = _local.free[index];
+    if (slot == nullptr) {
+        return ::operator new((index + 1) * slot_step);
+    }
+    _local.free[index] = slot->next;
+    --_local.counts[index];
+    return slot;
+}
+
+void FramePool::deallocate(void *frame, size_t size) noexcept {
+    if (size == 0 || size > max_slot_size) {
+        ::operator delete(frame);
+        return;
+    }
+    auto index = (size - 1) / slot_step;
+    if (_local.counts[index] >= local_size) {
+        ::operator delete(frame);
+        return;
+    }
+    _local.free[index] = new (frame) local_t::slot_t{_local.free[index]};
+    ++_local.counts[index];
+}
+
+}
@@ -0,0 +1,165 @@
+#include "handover.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace bstcp {
+
+static const char *listen_fds_var = "BSTCP_LISTEN_FDS";
+static const char *ready_fd_var = "BSTCP_READY_FD";
+
+static bool set_cloexec(int fd, bool enable) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags == -1) {
+        return false;
+    }
+    flags = enable ? (flags | FD_CLOEXEC) : (flags & ~FD_CLOEXEC);
+    return fcntl(fd, F_SETFD, flags) != -1;
+}
+
+static bool is_listening(int fd) {
+    int listening = 0;
+    socklen_t size = sizeof(listening);
+    return getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &size) == 0
+           && listening != 0;
+}
+
+std::vector<socket_t> Handover::take_sockets() {
+    std::vector<socket_t> sockets;
+    const char *value = getenv(listen_fds_var);
+    if (value == nullptr) {
+        return sockets;
+    }
+
+    // Comma separated descriptors, anything else is ignored
+    char *end = nullptr;
+    for (const char *next = value; *next != '\0'; next = end + (*end == ',' ? 1 : 0)) {
+        long fd = strtol(next, &end, 10);
+        if (end == next) {
+            break;
+        }
+        if (fd > STDERR_FILENO && fd <= INT32_MAX && is_listening((int)fd)) {
+            set_cloexec((int)fd, true);
+            sockets.push_back((socket_t)fd);
+        }
+    }
+    unsetenv(listen_fds_var);
+    return sockets;
+}
+
+void Handover::notify_ready() {
+    const char *value = getenv(ready_fd_var);
+    if (value == nullptr) {
+        return;
+    }
+
+    long fd = strtol(value, nullptr, 10);
+    if (fd > STDERR_FILENO && fd <= INT32_MAX) {
+        char ready = 1;
+        (void)!write((int)fd, &ready, sizeof(ready));
+        close((int)fd);
+    }
+    unsetenv(ready_fd_var);
+}
+
+// Waits for the byte written by notify_ready, false if the pipe is closed
+// without it or the timeout passes
+static bool wait_ready(int fd, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    pollfd ready{fd, POLLIN, 0};
+    while (true) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            return false;
+        }
+
+        int res = poll(&ready, 1, (int)left);
+        if (res == -1 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return false;
+        }
+
+        char byte = 0;
+        return read(fd, &byte, sizeof(byte)) == sizeof(byte);
+    }
+}
+
+pid_t Handover::spawn(char *const argv[], const std::vector<socket_t> &sockets,
+                      std::chrono::milliseconds timeout) {
+    if (sockets.empty()) {
+        return -1;
+    }
+
+    int ready[2];
+    if (pipe2(ready, O_CLOEXEC) == -1) {
+        return -1;
+    }
+
+    std::string listen_fds = std::string(listen_fds_var) + '=';
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        listen_fds += (i == 0 ? "" : ",") + std::to_string(sockets[i]);
+    }
+    std::string ready_fd = std::string(ready_fd_var) + '=' + std::to_string(ready[1]);
+
+    // Variables of a previous handover are replaced
+    std::vector<char *> envp;
+    for (char **var = environ; *var != nullptr; ++var) {
+        std::string_view name(*var);
+        if (!name.starts_with(listen_fds_var) && !name.starts_with(ready_fd_var)) {
+            envp.push_back(*var);
+        }
+    }
+    envp.push_back(listen_fds.data());
+    envp.push_back(ready_fd.data());
+    envp.push_back(nullptr);
+
+    // Signals waited for by the caller are blocked, the successor starts
+    // with none blocked
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    // Only these descriptors are inherited, everything else is CLOEXEC
+    for (auto socket: sockets) {
+        set_cloexec(socket, false);
+    }
+    set_cloexec(ready[1], false);
+
+    pid_t pid = -1;
+    if (posix_spawnp(&pid, argv[0], nullptr, &attr, argv, envp.data()) != 0) {
+        pid = -1;
+    }
+
+    posix_spawnattr_destroy(&attr);
+    for (auto socket: sockets) {
+        set_cloexec(socket, true);
+    }
+    close(ready[1]);
+
+    if (pid != -1 && !wait_ready(ready[0], timeout)) {
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+        pid = -1;
+    }
+    close(ready[0]);
+    return pid;
+}
+
+}
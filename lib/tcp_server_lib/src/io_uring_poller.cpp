@@ -0,0 +1,418 @@
+#include "io_uring_poller.hpp"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <csignal>
+#include <cerrno>
+#include <algorithm>
+
+namespace bstcp {
+
+static const unsigned ring_entries = 1024;
+
+// Completions of removals are not interesting; registrations
+// of clients never have these bits set
+static const uint64_t internal_data = 1ull << 63;
+static const uint64_t server_data = 1ull << 62;
+
+static const uint32_t read_events = POLLIN | POLLRDHUP;
+static const uint32_t write_events = POLLOUT | POLLRDHUP;
+
+IoUring::IoUring() {
+    if (!_setup(ring_entries) && _ring_fd != -1) {
+        ::close(_ring_fd);
+        _ring_fd = -1;
+    }
+}
+
+IoUring::~IoUring() {
+    if (_sqes != nullptr) {
+        munmap(_sqes, _sqes_size);
+    }
+    if (_ring != nullptr) {
+        munmap(_ring, _ring_size);
+    }
+    if (_ring_fd != -1) {
+        ::close(_ring_fd);
+    }
+}
+
+bool IoUring::_setup(unsigned entries) {
+    struct io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = entries * 4;
+
+    _ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (_ring_fd < 0) {
+        _ring_fd = -1;
+        return false;
+    }
+
+    // Timeout of a wait and keeping completions on overflow are required
+    const unsigned features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP
+                              | IORING_FEAT_EXT_ARG;
+    if ((params.features & features) != features) {
+        return false;
+    }
+
+    _ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                          params.cq_off.cqes
+                          + params.cq_entries * sizeof(struct io_uring_cqe));
+    auto *ring = mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    _ring = ring;
+
+    _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    auto *sqes = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    _sqes = static_cast<struct io_uring_sqe *>(sqes);
+
+    auto *base = static_cast<char *>(_ring);
+    _sq_head = reinterpret_cast<unsigned *>(base + params.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned *>(base + params.sq_off.tail);
+    _sq_mask = *reinterpret_cast<unsigned *>(base + params.sq_off.ring_mask);
+    _sq_entries = params.sq_entries;
+    _sq_local_tail = *_sq_tail;
+
+    // Submission entries are always used in ring order
+    auto *array = reinterpret_cast<unsigned *>(base + params.sq_off.array);
+    for (unsigned i = 0; i < _sq_entries; ++i) {
+        array[i] = i;
+    }
+
+    _cq_head = reinterpret_cast<unsigned *>(base + params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned *>(base + params.cq_off.tail);
+    _cq_mask = *reinterpret_cast<unsigned *>(base + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<struct io_uring_cqe *>(base + params.cq_off.cqes);
+    return true;
+}
+
+bool IoUring::is_valid() const {
+    return _ring_fd != -1;
+}
+
+PollerType IoUring::get_type() const {
+    return PollerType::io_uring;
+}
+
+struct io_uring_sqe *IoUring::_get_sqe() {
+    auto head = std::atomic_ref(*_sq_head).load(std::memory_order_acquire);
+    if (_sq_local_tail - head >= _sq_entries) {
+        // Ring is full, give queued requests to the kernel first
+        if (_submit() < 0) {
+            return nullptr;
+        }
+        head = std::atomic_ref(*_sq_head).load(std::memory_order_acquire);
+        if (_sq_local_tail - head >= _sq_entries) {
+            return nullptr;
+        }
+    }
+
+    auto *sqe = &_sqes[_sq_local_tail & _sq_mask];
+    *sqe = {};
+    return sqe;
+}
+
+void IoUring::_commit_sqe() {
+    ++_sq_local_tail;
+    std::atomic_ref(*_sq_tail).store(_sq_local_tail, std::memory_order_release);
+}
+
+bool IoUring::_poll_add(socket_t socket, uint32_t events, uint64_t data) {
+    auto *sqe = _get_sqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = socket;
+    sqe->poll32_events = events;
+    sqe->user_data = data;
+    _commit_sqe();
+    return true;
+}
+
+bool IoUring::_accept(socket_t socket) {
+    auto *sqe = _get_sqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = server_data;
+    _commit_sqe();
+    return true;
+}
+
+void IoUring::_cancel(uint64_t data) {
+    auto *sqe = _get_sqe();
+    if (sqe == nullptr) {
+        // Armed request keeps the socket open until it is cancelled
+        _pending_removals.push_back(data);
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = data;
+    sqe->user_data = internal_data;
+    _commit_sqe();
+}
+
+void IoUring::_retry_removals() {
+    auto pending = std::move(_pending_removals);
+    _pending_removals.clear();
+    for (auto data: pending) {
+        _cancel(data);
+    }
+}
+
+unsigned IoUring::_queued() const {
+    return _sq_local_tail
+           - std::atomic_ref(*_sq_head).load(std::memory_order_acquire);
+}
+
+int IoUring::_submit() {
+    while (auto to_submit = _queued()) {
+        auto res = (int)syscall(__NR_io_uring_enter, _ring_fd, to_submit, 0, 0,
+                                nullptr, 0);
+        if (res >= 0) {
+            return res;
+        }
+        // EBUSY and EAGAIN last until the loop takes completions
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+int IoUring::_submit_and_wait(unsigned to_submit) {
+    auto timeout_ms = _wait_config.timeout.count();
+    struct __kernel_timespec ts{};
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+    struct io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    return (int)syscall(__NR_io_uring_enter, _ring_fd, to_submit, 1,
+                        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                        &arg, sizeof(arg));
+}
+
+void IoUring::_submit_if_waiting() {
+    // Otherwise the request goes with the next wait
+    if (_waiting) {
+        _submit();
+    }
+}
+
+void IoUring::wait(std::vector<epoll_event_t> &selected) {
+    selected.clear();
+    if (!_serv_socket) {
+        return;
+    }
+
+    unsigned to_submit = 0;
+    {
+        std::lock_guard lock(_mutex);
+        _retry_removals();
+        if (!_server_armed && _serv_socket && _listening) {
+            // Multishot accept ends on errors, a one-shot poll with every
+            // event; either is armed again here
+            auto server = _serv_socket->get_socket();
+            _server_armed = _multishot ? _accept(server)
+                                       : _poll_add(server, POLLIN, server_data);
+        }
+        _waiting = true;
+        to_submit = _queued();
+    }
+
+    // Queued requests are sent in the same call; a request queued
+    // by other thread right now is submitted by that thread
+    _submit_and_wait(to_submit);
+
+    std::lock_guard lock(_mutex);
+    _waiting = false;
+
+    auto head = *_cq_head;
+    auto tail = std::atomic_ref(*_cq_tail).load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+        _handle_completion(_cqes[head & _cq_mask], selected);
+    }
+    std::atomic_ref(*_cq_head).store(head, std::memory_order_release);
+
+    _expire(selected);
+}
+
+void IoUring::_handle_completion(const struct io_uring_cqe &cqe,
+                                 std::vector<epoll_event_t> &selected) {
+    if (cqe.user_data & internal_data) {
+        return;
+    }
+
+    if (cqe.user_data == server_data) {
+        _handle_server(cqe, selected);
+        return;
+    }
+
+    // Cancelled polls belong to deleted clients
+    if (cqe.res == -ECANCELED) {
+        return;
+    }
+
+    Client client;
+    if (!_clients.acquire(cqe.user_data, client)) {
+        return;
+    }
+
+    event_t event;
+    auto events = (uint32_t)cqe.res;
+    if (cqe.res < 0) {
+        event = event_t::err;
+    } else if (events & POLLHUP || (events & POLLRDHUP && !(events & POLLIN))) {
+        event = event_t::close;
+    } else if (events & POLLIN) {
+        event = event_t::can_read;
+    } else if (events & POLLOUT) {
+        event = event_t::can_write;
+    } else {
+        event = event_t::err;
+    }
+    selected.push_back({client, event});
+}
+
+void IoUring::_handle_server(const struct io_uring_cqe &cqe,
+                             std::vector<epoll_event_t> &selected) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        _server_armed = false;
+    }
+
+    if (!_multishot) {
+        if (cqe.res > 0 && _serv_socket) {
+            epoll_event_t event;
+            event.event = event_t::need_accept;
+            selected.push_back(event);
+        }
+        return;
+    }
+
+    if (cqe.res >= 0) {
+        // Connections accepted before the cancel of a draining poller
+        // are not served
+        if (!_serv_socket || !_listening) {
+            ::close(cqe.res);
+            return;
+        }
+        epoll_event_t event;
+        event.client.socket = cqe.res;
+        event.event = event_t::accepted;
+        selected.push_back(event);
+    } else if (cqe.res == -EINVAL && _listening) {
+        // Kernel before 5.19, the socket is polled from now on
+        _multishot = false;
+    }
+}
+
+bool IoUring::add_client(client_ptr&& client) {
+    Client added;
+    if (!_clients.add(std::move(client), added)) {
+        return false;
+    }
+
+    if (!_arm(added, event_t::can_read)) {
+        bool was_armed;
+        _clients.remove(added, was_armed);
+        return false;
+    }
+    return true;
+}
+
+bool IoUring::rearm_client(const Client &client, event_t event) {
+    return _arm(client, event);
+}
+
+bool IoUring::_arm(const Client &client, event_t event) {
+    // Slot is armed first, the completion may come right after the submit
+    if (!_give_back(client, event)) {
+        return false;
+    }
+
+    std::lock_guard lock(_mutex);
+    if (!_poll_add(client.socket, event == event_t::can_write ? write_events : read_events,
+                   ConnectionTable::key(client))) {
+        // Otherwise the client expired meanwhile and is closed by its event
+        return !_clients.disarm(client);
+    }
+    _submit_if_waiting();
+    return true;
+}
+
+client_ptr IoUring::delete_client(const Client &client) {
+    bool was_armed;
+    auto owned = _clients.remove(client, was_armed);
+    if (owned && was_armed) {
+        // Armed poll holds the socket open, so it is removed right away
+        std::lock_guard lock(_mutex);
+        _cancel(ConnectionTable::key(client));
+        _submit();
+    }
+    return owned;
+}
+
+bool IoUring::add_server_socket(std::unique_ptr<ISocket> server) {
+    std::lock_guard lock(_mutex);
+    _serv_socket = std::move(server);
+    _server_armed = false;
+    return true;
+}
+
+void IoUring::_remove_polls() {
+    _clients.clear([this](const Client &client) {
+        _cancel(ConnectionTable::key(client));
+    });
+}
+
+void IoUring::_stop_listening() {
+    std::lock_guard lock(_mutex);
+    _listening = false;
+    if (_server_armed) {
+        _cancel(server_data);
+        _server_armed = false;
+        _submit();
+    }
+}
+
+void IoUring::stop() {
+    std::lock_guard lock(_mutex);
+    if (_serv_socket) {
+        if (_server_armed) {
+            _cancel(server_data);
+            _server_armed = false;
+        }
+        _submit();
+        _serv_socket->disconnect();
+        _serv_socket = nullptr;
+    }
+
+    _remove_polls();
+    _submit();
+}
+
+void IoUring::delete_all() {
+    std::lock_guard lock(_mutex);
+    _remove_polls();
+    _submit();
+}
+
+}
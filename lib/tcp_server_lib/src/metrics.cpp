@@ -0,0 +1,231 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace bstcp {
+
+static const size_t sub_buckets_count = 8;
+static const size_t sub_bucket_bits = 3;
+static const size_t buckets_count = (64 - sub_bucket_bits + 1) * sub_buckets_count;
+
+static const size_t histograms_count = (size_t)Histogram::count;
+static const size_t counters_count = (size_t)Counter::count;
+
+// Exported bounds are powers of two, which are bounds of buckets too:
+// from about a microsecond to 17 seconds
+static const size_t min_exported_power = 10;
+static const size_t max_exported_power = 34;
+
+namespace {
+
+struct metric_name_t {
+    const char *name;
+    const char *help;
+};
+
+const metric_name_t histogram_names[histograms_count] = {
+        {"httpd_accept_latency_seconds", "Time to accept a connection and add it to the poller"},
+        {"httpd_queue_wait_seconds", "Time a task waits in the thread pool queue"},
+        {"httpd_parse_seconds", "Time to parse a request"},
+        {"httpd_lookup_seconds", "Time to find the requested file"},
+        {"httpd_send_seconds", "Time to flush queued output to a socket"},
+};
+
+const metric_name_t counter_names[counters_count] = {
+        {"httpd_accepted_connections_total", "Accepted connections"},
+        {"httpd_requests_total", "Handled requests"},
+        {"httpd_sent_bytes_total", "Bytes sent to clients"},
+        {"httpd_access_log_dropped_total", "Access log entries dropped under overload"},
+        {"httpd_idle_timeouts_total", "Connections closed waiting for the next request"},
+        {"httpd_header_timeouts_total", "Connections closed receiving a request head"},
+        {"httpd_write_timeouts_total", "Connections closed with output stalled"},
+        {"httpd_session_errors_total", "Connections closed by an exception while serving"},
+};
+
+struct histogram_t {
+    std::array<std::atomic<uint64_t>, buckets_count>    buckets{};
+    std::atomic<uint64_t>                               sum{0};
+    std::atomic<uint64_t>                               count{0};
+};
+
+struct block_t {
+    std::array<histogram_t, histograms_count>               histograms;
+    std::array<std::atomic<uint64_t>, counters_count>       counters{};
+};
+
+struct gauge_t {
+    std::string             name;
+    std::string             help;
+    std::function<double()> value;
+};
+
+struct registry_t {
+    std::mutex              mutex;
+    std::vector<block_t *>  blocks;
+    // Sum of blocks of finished threads
+    block_t                 retired;
+    std::vector<gauge_t>    gauges;
+};
+
+// Never destroyed: threads may finish after static destructors ran
+registry_t &registry() {
+    static auto *registry = new registry_t();
+    return *registry;
+}
+
+// Only the owner thread writes a block, so no read-modify-write is needed
+void bump(std::atomic<uint64_t> &value, uint64_t add) {
+    value.store(value.load(std::memory_order_relaxed) + add, std::memory_order_relaxed);
+}
+
+void merge(block_t &to, const block_t &from) {
+    for (size_t i = 0; i < histograms_count; ++i) {
+        auto &dst = to.histograms[i];
+        const auto &src = from.histograms[i];
+        for (size_t j = 0; j < buckets_count; ++j) {
+            bump(dst.buckets[j], src.buckets[j].load(std::memory_order_relaxed));
+        }
+        bump(dst.sum, src.sum.load(std::memory_order_relaxed));
+        bump(dst.count, src.count.load(std::memory_order_relaxed));
+    }
+    for (size_t i = 0; i < counters_count; ++i) {
+        bump(to.counters[i], from.counters[i].load(std::memory_order_relaxed));
+    }
+}
+
+struct local_block_t {
+    block_t *block = nullptr;
+
+    ~local_block_t() {
+        if (!block) {
+            return;
+        }
+        auto &reg = registry();
+        std::lock_guard lock(reg.mutex);
+        merge(reg.retired, *block);
+        std::erase(reg.blocks, block);
+        delete block;
+    }
+};
+
+thread_local local_block_t local;
+
+block_t &local_block() {
+    if (!local.block) {
+        auto *block = new block_t();
+        auto &reg = registry();
+        std::lock_guard lock(reg.mutex);
+        reg.blocks.push_back(block);
+        local.block = block;
+    }
+    return *local.block;
+}
+
+// Values below sub_buckets_count have own buckets, others share
+// a bucket with values of the same power of two and top bits
+size_t bucket_index(uint64_t value) {
+    if (value < sub_buckets_count) {
+        return value;
+    }
+    auto shift = (size_t)std::bit_width(value) - 1 - sub_bucket_bits;
+    return (shift + 1) * sub_buckets_count + (size_t)(value >> shift) - sub_buckets_count;
+}
+
+void append_help(std::string &out, const char *name, const char *help, const char *type) {
+    out += (std::string)"# HELP " + name + " " + help + "\n";
+    out += (std::string)"# TYPE " + name + " " + type + "\n";
+}
+
+void append_histogram(std::string &out, const metric_name_t &name,
+                      const histogram_t &histogram) {
+    append_help(out, name.name, name.help, "histogram");
+
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (auto power = min_exported_power; power <= max_exported_power; ++power) {
+        auto bound = (uint64_t)1 << power;
+        for (auto end = bucket_index(bound); bucket < end; ++bucket) {
+            cumulative += histogram.buckets[bucket].load(std::memory_order_relaxed);
+        }
+
+        char le[32];
+        snprintf(le, sizeof(le), "%.9g", (double)bound / 1e9);
+        out += (std::string)name.name + "_bucket{le=\"" + le + "\"} "
+               + std::to_string(cumulative) + "\n";
+    }
+
+    auto count = histogram.count.load(std::memory_order_relaxed);
+    char sum[32];
+    snprintf(sum, sizeof(sum), "%.9f",
+             (double)histogram.sum.load(std::memory_order_relaxed) / 1e9);
+    out += (std::string)name.name + "_bucket{le=\"+Inf\"} " + std::to_string(count) + "\n";
+    out += (std::string)name.name + "_sum " + sum + "\n";
+    out += (std::string)name.name + "_count " + std::to_string(count) + "\n";
+}
+
+}
+
+int64_t Metrics::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Metrics::record(Histogram histogram, int64_t duration_ns) {
+    auto value = (uint64_t)std::max<int64_t>(duration_ns, 0);
+    auto &data = local_block().histograms[(size_t)histogram];
+    bump(data.buckets[bucket_index(value)], 1);
+    bump(data.sum, value);
+    bump(data.count, 1);
+}
+
+void Metrics::add(Counter counter, uint64_t value) {
+    bump(local_block().counters[(size_t)counter], value);
+}
+
+void Metrics::add_gauge(std::string name, std::string help,
+                        std::function<double()> value) {
+    auto &reg = registry();
+    std::lock_guard lock(reg.mutex);
+    reg.gauges.push_back({std::move(name), std::move(help), std::move(value)});
+}
+
+std::string Metrics::render() {
+    auto total = std::make_unique<block_t>();
+    std::vector<gauge_t> gauges;
+    {
+        auto &reg = registry();
+        std::lock_guard lock(reg.mutex);
+        merge(*total, reg.retired);
+        for (const auto *block: reg.blocks) {
+            merge(*total, *block);
+        }
+        gauges = reg.gauges;
+    }
+
+    std::string out;
+    for (size_t i = 0; i < histograms_count; ++i) {
+        append_histogram(out, histogram_names[i], total->histograms[i]);
+    }
+    for (size_t i = 0; i < counters_count; ++i) {
+        append_help(out, counter_names[i].name, counter_names[i].help, "counter");
+        out += (std::string)counter_names[i].name + " "
+               + std::to_string(total->counters[i].load(std::memory_order_relaxed)) + "\n";
+    }
+    for (const auto &gauge: gauges) {
+        char value[32];
+        snprintf(value, sizeof(value), "%.17g", gauge.value());
+        append_help(out, gauge.name.c_str(), gauge.help.c_str(), "gauge");
+        out += gauge.name + " " + value + "\n";
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,172 @@
+#include "output_queue.hpp"
+
+#include "metrics.hpp"
+
+namespace bstcp {
+
+static const size_t max_iov_count = 64;
+static const size_t max_buffered = 1024 * 1024;
+// Larger buffers are freed after sending instead of being kept for reuse
+static const size_t max_kept_buffer = 16 * 1024;
+
+std::string_view OutputQueue::segment_t::rest() const {
+    return (owner ? data : std::string_view(buffer)).substr(sent);
+}
+
+void OutputQueue::push(std::string data) {
+    if (data.empty()) {
+        return;
+    }
+    _buffered += data.size();
+    _pushed += data.size();
+
+    auto &segment = _emplace_back();
+    segment.buffer = std::move(data);
+}
+
+void OutputQueue::push(std::string_view data, std::shared_ptr<const void> owner) {
+    if (data.empty()) {
+        return;
+    }
+    _buffered += data.size();
+    _pushed += data.size();
+
+    auto &segment = _emplace_back();
+    segment.data = data;
+    segment.owner = std::move(owner);
+}
+
+void OutputQueue::push(FileRange range) {
+    if (range.empty()) {
+        return;
+    }
+    _pushed += range.size();
+
+    auto &segment = _emplace_back();
+    segment.file = std::move(range);
+    segment.is_file = true;
+}
+
+void OutputQueue::append(std::string_view data) {
+    if (data.empty()) {
+        return;
+    }
+    _buffered += data.size();
+    _pushed += data.size();
+
+    if (_end > _first) {
+        auto &last = _segments[_end - 1];
+        if (!last.is_file && !last.owner) {
+            last.buffer.append(data);
+            return;
+        }
+    }
+    _emplace_back().buffer.append(data);
+}
+
+OutputQueue::segment_t &OutputQueue::_emplace_back() {
+    if (_end == _segments.size()) {
+        _segments.emplace_back();
+    }
+    return _segments[_end++];
+}
+
+void OutputQueue::_pop_front() {
+    auto &segment = _segments[_first++];
+    if (segment.buffer.capacity() > max_kept_buffer) {
+        std::string().swap(segment.buffer);
+    }
+    segment.buffer.clear();
+    segment.data = {};
+    segment.owner.reset();
+    segment.file.reset();
+    segment.is_file = false;
+    segment.sent = 0;
+
+    if (_first == _end) {
+        _first = _end = 0;
+    }
+}
+
+size_t OutputQueue::_size() const {
+    return _end - _first;
+}
+
+TransferStatus OutputQueue::_send_buffers(BaseSocket &socket) {
+    struct iovec iov[max_iov_count];
+    size_t count = 0;
+    for (auto i = _first; i < _end; ++i) {
+        const auto &segment = _segments[i];
+        if (segment.is_file || count == max_iov_count) {
+            break;
+        }
+        auto rest = segment.rest();
+        iov[count++] = {const_cast<char *>(rest.data()), rest.size()};
+    }
+
+    // More data follows, so the kernel may wait to fill full packets
+    auto sent = socket.send_vector(iov, count, count < _size());
+    if (sent < 0) {
+        return TransferStatus::error;
+    }
+    if (sent == 0) {
+        return TransferStatus::would_block;
+    }
+
+    auto left = (size_t)sent;
+    _buffered -= left;
+    Metrics::add(Counter::bytes_out, left);
+    while (left > 0) {
+        auto &segment = _segments[_first];
+        auto size = segment.rest().size();
+        if (left < size) {
+            segment.sent += left;
+            break;
+        }
+        left -= size;
+        _pop_front();
+    }
+    return TransferStatus::done;
+}
+
+TransferStatus OutputQueue::flush(BaseSocket &socket) {
+    while (_first < _end) {
+        auto &front = _segments[_first];
+        if (!front.is_file) {
+            if (auto sts = _send_buffers(socket); sts != TransferStatus::done) {
+                return sts;
+            }
+            continue;
+        }
+
+        auto before = front.file.size();
+        auto sts = front.file.send_to(socket.get_socket());
+        Metrics::add(Counter::bytes_out, before - front.file.size());
+        if (sts != TransferStatus::done) {
+            return sts;
+        }
+        _pop_front();
+    }
+    return TransferStatus::done;
+}
+
+bool OutputQueue::empty() const {
+    return _first == _end;
+}
+
+size_t OutputQueue::get_pushed() const {
+    return _pushed;
+}
+
+bool OutputQueue::is_full() const {
+    return _size() >= max_iov_count || _buffered >= max_buffered;
+}
+
+void OutputQueue::clear() {
+    while (_first < _end) {
+        _pop_front();
+    }
+    _buffered = 0;
+}
+
+}
@@ -2,81 +2,224 @@
 
 #include <utility>
 
+#include "metrics.hpp"
+
 namespace prll {
 
+static const size_t spin_count = 64;
+static const size_t steal_rounds = 2;
+
+struct current_worker_t {
+    const Parallel  *pool   = nullptr;
+    size_t          index   = 0;
+};
+
+static thread_local current_worker_t current_worker;
+
 Parallel::Parallel()
-        : _exit(false)
-          , _max_threads(MAXNTHREADS)
-          , _threads() {
-    _main_thread = std::thread(&Parallel::_supervisor, this);
-}
+        : _max_threads(MAXNTHREADS)
+          , _workers() {}
 
 void Parallel::set_max_threads(size_t max_threads) {
-    {
-        std::lock_guard lk(_task_mutex);
-        _max_threads = max_threads;
+    _stop_workers();
+
+    std::lock_guard lk(_task_mutex);
+    _max_threads = max_threads;
+    if (!_tasks.empty() && !_exit && _max_threads > 0) {
+        _start_workers();
     }
-    _wait.notify_one();
 }
 
 Parallel::~Parallel() {
-    if (!_exit) {
-        stop();
-    }
+    stop();
 }
 
-Parallel::Thread::Thread(std::function<void()> task,
-                         std::condition_variable &wait)
-        : _have_proccess(0)
-        , _wait(wait)
-        , _task(std::move(task)) {
-    _have_proccess++;
-    _main_thread = std::thread(&Thread::_main, this);
+size_t Parallel::_current_worker() const {
+    return current_worker.pool == this ? current_worker.index : external_owner;
 }
 
-void Parallel::Thread::join() {
-    _main_thread.join();
+Task *Parallel::_make_task() {
+    auto index = _current_worker();
+    if (index == external_owner) {
+        auto *task = new Task();
+        task->_owner = external_owner;
+        return task;
+    }
+
+    auto &worker = *_workers[index];
+    if (!worker.free_tasks) {
+        worker.free_tasks = worker.returned_tasks.exchange(
+                nullptr, std::memory_order_acquire);
+    }
+    if (auto *task = worker.free_tasks) {
+        worker.free_tasks = task->_next;
+        return task;
+    }
+
+    auto *task = new Task();
+    task->_owner = index;
+    return task;
 }
 
-bool Parallel::Thread::is_finished() const {
-    return _have_proccess == 0;
+void Parallel::_recycle(Task *task) {
+    task->reset();
+    if (task->_owner == external_owner) {
+        delete task;
+        return;
+    }
+
+    auto &owner = *_workers[task->_owner];
+    if (task->_owner == _current_worker()) {
+        task->_next = owner.free_tasks;
+        owner.free_tasks = task;
+        return;
+    }
+
+    // Task came from other worker, give it back through its return stack
+    task->_next = owner.returned_tasks.load(std::memory_order_relaxed);
+    while (!owner.returned_tasks.compare_exchange_weak(
+            task->_next, task,
+            std::memory_order_release, std::memory_order_relaxed)) {}
 }
 
-Parallel::Thread::~Thread() {
-    join();
+void Parallel::_push(Task *task) {
+    if (_exit) {
+        _recycle(task);
+        return;
+    }
+
+    // Counted before the task is visible, so a worker seeing it
+    // never decrements the counter below zero
+    _pending.fetch_add(1);
+    task->_queued_at = bstcp::Metrics::now();
+
+    auto index = _current_worker();
+    if (index != external_owner) {
+        _workers[index]->tasks.push(task);
+    } else {
+        std::lock_guard lk(_task_mutex);
+        if (_workers.empty() && !_exit) {
+            _start_workers();
+        }
+        _tasks.push_back(task);
+    }
 }
 
-void Parallel::Thread::_main() {
-    _task();
-    _have_proccess--;
+void Parallel::_notify(size_t count) {
+    auto sleeping = _sleeping.load();
+    if (sleeping == 0) {
+        return;
+    }
 
-    _wait.notify_one();
+    std::lock_guard lk(_sleep_mutex);
+    for (size_t i = 0; i < count && i < sleeping; ++i) {
+        _wait.notify_one();
+    }
 }
 
-void Parallel::_supervisor() {
-    while (true) {
-        std::unique_lock<std::mutex> lck(_task_mutex);
+Task *Parallel::_find_task(size_t index) {
+    if (auto *task = _workers[index]->tasks.take()) {
+        return task;
+    }
 
-        _wait.wait(lck, [this] {
-            {
-                std::lock_guard<std::mutex> thr_lck(_thread_mutex);
-                _threads.remove_if([](const auto &thread) {
-                    return thread->is_finished();
-                });
+    {
+        std::unique_lock lk(_task_mutex, std::try_to_lock);
+        if (lk.owns_lock() && !_tasks.empty()) {
+            auto *task = _tasks.front();
+            _tasks.pop_front();
+            return task;
+        }
+    }
+
+    auto count = _workers.size();
+    for (size_t round = 0; round < steal_rounds; ++round) {
+        for (size_t i = 1; i < count; ++i) {
+            if (auto *task = _workers[(index + i) % count]->tasks.steal()) {
+                return task;
             }
-            return _exit || (!_tasks.empty() && _threads.size() < (size_t) _max_threads);
+        }
+    }
+    return nullptr;
+}
+
+void Parallel::_worker_main(size_t index) {
+    current_worker = {this, index};
+
+    size_t idle = 0;
+    while (_running.load(std::memory_order_acquire)) {
+        if (auto *task = _find_task(index)) {
+            _pending.fetch_sub(1);
+            bstcp::Metrics::record(bstcp::Histogram::queue_wait,
+                                   bstcp::Metrics::now() - task->_queued_at);
+            (*task)();
+            _recycle(task);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < spin_count) {
+            std::this_thread::yield();
+            continue;
+        }
+        idle = 0;
+
+        std::unique_lock lck(_sleep_mutex);
+        _sleeping.fetch_add(1);
+        _wait.wait(lck, [this] {
+            return !_running || _pending.load() > 0;
         });
+        _sleeping.fetch_sub(1);
+    }
 
-        if (_exit) {
-            break;
+    current_worker = {};
+}
+
+void Parallel::_start_workers() {
+    _running = true;
+    for (size_t i = 0; i < _max_threads; ++i) {
+        _workers.emplace_back(new Worker());
+    }
+    for (size_t i = 0; i < _max_threads; ++i) {
+        _workers[i]->thread = std::thread(&Parallel::_worker_main, this, i);
+    }
+}
+
+void Parallel::_stop_workers() {
+    {
+        std::lock_guard lk(_task_mutex);
+        if (_workers.empty()) {
+            return;
         }
+    }
+
+    {
+        std::lock_guard lk(_sleep_mutex);
+        _running = false;
+    }
+    _wait.notify_all();
+
+    for (auto &worker: _workers) {
+        worker->thread.join();
+    }
+
+    auto free_tasks = [](Task *task) {
+        while (task) {
+            auto *next = task->_next;
+            delete task;
+            task = next;
+        }
+    };
 
-        std::lock_guard<std::mutex> thr_lck(_thread_mutex);
-        while (!_tasks.empty() && _threads.size() < (size_t) _max_threads) {
-            _threads.emplace_back(new Thread(_tasks.front(), _wait));
-            _tasks.pop();
+    std::lock_guard lk(_task_mutex);
+    for (auto &worker: _workers) {
+        while (auto *task = worker->tasks.take()) {
+            task->_owner = external_owner;
+            _tasks.push_back(task);
         }
+        free_tasks(worker->free_tasks);
+        free_tasks(worker->returned_tasks.exchange(nullptr));
     }
+    _workers.clear();
 }
 
 size_t Parallel::get_count_threads() const {
@@ -84,13 +227,29 @@ size_t Parallel::get_count_threads() const {
 }
 
 void Parallel::stop() {
-    _exit = true;
-    _wait.notify_one();
-    _main_thread.join();
-    join();
+    {
+        std::lock_guard lk(_sleep_mutex);
+        if (_exit) {
+            return;
+        }
+        _exit = true;
+    }
+    _stopped.notify_all();
+
+    _stop_workers();
+
+    std::lock_guard lk(_task_mutex);
+    for (auto *task: _tasks) {
+        delete task;
+    }
+    _tasks.clear();
+    _pending = 0;
 }
 
 void Parallel::join() {
-    _main_thread.join();
+    std::unique_lock lck(_sleep_mutex);
+    _stopped.wait(lck, [this] {
+        return _exit.load();
+    });
+}
 }
-}
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include "poller.hpp"
+
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "epoll.hpp"
+#include "io_uring_poller.hpp"
+#include "metrics.hpp"
+
+namespace bstcp {
+
+// Wheel of the table moves in ticks of the same length
+const auto expire_interval = std::chrono::milliseconds(100);
+
+Poller::Poller()
+    : _next_expire(0) {
+    set_timeouts({});
+}
+
+std::unique_ptr<Poller> Poller::create(PollerType type) {
+    if (type == PollerType::io_uring) {
+        std::unique_ptr<IoUring> ring(new IoUring());
+        if (ring->is_valid()) {
+            return ring;
+        }
+    }
+    return std::unique_ptr<Poller>(new Epoll());
+}
+
+int64_t Poller::now() {
+    return ConnectionTable::now();
+}
+
+static void count_timeout(Timeout timeout) {
+    switch (timeout) {
+        case Timeout::header:
+            Metrics::add(Counter::header_timeouts);
+            break;
+        case Timeout::write:
+            Metrics::add(Counter::write_timeouts);
+            break;
+        case Timeout::linger:
+            // Connection is being closed anyway
+            break;
+        default:
+            Metrics::add(Counter::idle_timeouts);
+            break;
+    }
+}
+
+bool Poller::_give_back(const Client &client, event_t event) {
+    int64_t since = 0;
+    auto timeout = client.client->get_timeout(since);
+    if (timeout == Timeout::none || timeout >= Timeout::count) {
+        timeout = event == event_t::can_write ? Timeout::write : Timeout::idle;
+    }
+
+    if (timeout == Timeout::idle && _draining) {
+        return false;
+    }
+
+    int64_t deadline = 0;
+    if (auto limit = _timeouts[(size_t)timeout].load(std::memory_order_relaxed); limit > 0) {
+        deadline = (since > 0 ? since : now()) + limit;
+        // Client sending bit by bit is taken by its events whenever the
+        // wheel could see it, so its deadline is also checked here
+        if (deadline <= now()) {
+            count_timeout(timeout);
+            return false;
+        }
+    }
+    return _clients.arm(client, deadline, timeout);
+}
+
+void Poller::_expire(std::vector<epoll_event_t> &selected) {
+    thread_local std::vector<ConnectionTable::expired_t> expired;
+    if (_close_idle.exchange(false)) {
+        expired.clear();
+        _clients.expire_all(Timeout::idle, expired);
+        for (const auto &client: expired) {
+            selected.push_back({client.entry, event_t::close});
+        }
+    }
+
+    auto time = now();
+    auto next = _next_expire.load(std::memory_order_relaxed);
+    // Only one of concurrent waits moves the wheel
+    if (time < next
+        || !_next_expire.compare_exchange_strong(next, time + expire_interval.count())) {
+        return;
+    }
+
+    expired.clear();
+    _clients.expire(time, expired);
+    for (const auto &client: expired) {
+        count_timeout(client.timeout);
+        selected.push_back({client.entry, event_t::close});
+    }
+}
+
+void Poller::drain() {
+    if (!_draining.exchange(true) && _serv_socket) {
+        _stop_listening();
+        _close_listener();
+    }
+    _close_idle = true;
+}
+
+void Poller::_close_listener() {
+    auto listener = _serv_socket->get_socket();
+    int placeholder = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (placeholder != -1) {
+        dup3(placeholder, listener, O_CLOEXEC);
+        ::close(placeholder);
+    }
+}
+
+void Poller::set_timeouts(const timeouts_t &timeouts) {
+    auto set = [this](Timeout timeout, std::chrono::milliseconds limit) {
+        _timeouts[(size_t)timeout].store(limit.count(), std::memory_order_relaxed);
+    };
+    set(Timeout::idle, timeouts.idle);
+    set(Timeout::header, timeouts.header);
+    set(Timeout::write, timeouts.write);
+    set(Timeout::linger, timeouts.linger);
+}
+
+void Poller::set_wait_config(const wait_config_t &config) {
+    _wait_config = config;
+}
+
+const std::unique_ptr<ISocket> &Poller::get_server() const {
+    return _serv_socket;
+}
+
+void Poller::set_client_pool(std::unique_ptr<ClientPool> pool) {
+    _client_pool = std::move(pool);
+}
+
+ClientPool *Poller::get_client_pool() const {
+    return _client_pool.get();
+}
+
+}
@@ -0,0 +1,186 @@
+#include "recv_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace bstcp {
+
+BufferPool::~BufferPool() {
+    for (auto *block: _free) {
+        delete[] block;
+    }
+}
+
+BufferPool &BufferPool::instance() {
+    static BufferPool pool;
+    return pool;
+}
+
+// Blocks of a thread go to the shared list when it exits
+struct BufferPool::local_t {
+    std::vector<char *> blocks;
+
+    ~local_t() {
+        BufferPool::instance()._give(blocks, blocks.size());
+    }
+};
+
+thread_local BufferPool::local_t BufferPool::_local;
+
+char *BufferPool::acquire() {
+    if (_local.blocks.empty()) {
+        _take(_local.blocks, local_size / 2);
+        if (_local.blocks.empty()) {
+            return new char[block_size];
+        }
+    }
+    auto *block = _local.blocks.back();
+    _local.blocks.pop_back();
+    return block;
+}
+
+void BufferPool::release(char *block) {
+    _local.blocks.push_back(block);
+    if (_local.blocks.size() > local_size) {
+        _give(_local.blocks, local_size / 2);
+    }
+}
+
+void BufferPool::_take(std::vector<char *> &blocks, size_t count) {
+    std::lock_guard lock(_mutex);
+    count = std::min(count, _free.size());
+    blocks.insert(blocks.end(), _free.end() - (ptrdiff_t)count, _free.end());
+    _free.resize(_free.size() - count);
+}
+
+void BufferPool::_give(std::vector<char *> &blocks, size_t count) {
+    count = std::min(count, blocks.size());
+    auto first = blocks.end() - (ptrdiff_t)count;
+    {
+        std::lock_guard lock(_mutex);
+        auto kept = std::min(count, max_free - std::min(max_free, _free.size()));
+        _free.insert(_free.end(), first, first + (ptrdiff_t)kept);
+        first += (ptrdiff_t)kept;
+    }
+    for (auto it = first; it != blocks.end(); ++it) {
+        delete[] *it;
+    }
+    blocks.resize(blocks.size() - count);
+}
+
+RecvBuffer::RecvBuffer(RecvBuffer &&buffer) noexcept
+        : _data(buffer._data)
+        , _capacity(buffer._capacity)
+        , _begin(buffer._begin)
+        , _end(buffer._end)
+        , _consumed(buffer._consumed) {
+    buffer._data = nullptr;
+    buffer._capacity = buffer._begin = buffer._end = buffer._consumed = 0;
+}
+
+RecvBuffer &RecvBuffer::operator=(RecvBuffer &&buffer) noexcept {
+    if (this == &buffer) {
+        return *this;
+    }
+    _free();
+
+    _data       = buffer._data;
+    _capacity   = buffer._capacity;
+    _begin      = buffer._begin;
+    _end        = buffer._end;
+    _consumed   = buffer._consumed;
+
+    buffer._data = nullptr;
+    buffer._capacity = buffer._begin = buffer._end = buffer._consumed = 0;
+    return *this;
+}
+
+RecvBuffer::~RecvBuffer() {
+    _free();
+}
+
+std::string_view RecvBuffer::data() const {
+    return {_data + _begin, _end - _begin};
+}
+
+size_t RecvBuffer::size() const {
+    return _end - _begin;
+}
+
+bool RecvBuffer::empty() const {
+    return _begin == _end;
+}
+
+void RecvBuffer::consume(size_t size) {
+    size = std::min(size, _end - _begin);
+    _begin += size;
+    _consumed += size;
+    if (_begin == _end) {
+        _begin = _end = 0;
+    }
+}
+
+size_t RecvBuffer::get_consumed() const {
+    return _consumed;
+}
+
+char *RecvBuffer::prepare(size_t min_space) {
+    if (_capacity - _end >= min_space) {
+        return _data + _end;
+    }
+
+    auto used = _end - _begin;
+    if (_capacity - used >= min_space) {
+        std::memmove(_data, _data + _begin, used);
+    } else {
+        auto capacity = std::max(_capacity, BufferPool::block_size);
+        while (capacity - used < min_space) {
+            capacity *= 2;
+        }
+
+        auto *data = capacity == BufferPool::block_size
+                     ? BufferPool::instance().acquire()
+                     : new char[capacity];
+        if (used != 0) {
+            std::memcpy(data, _data + _begin, used);
+        }
+        _free();
+        _data = data;
+        _capacity = capacity;
+    }
+
+    _begin = 0;
+    _end = used;
+    return _data + _end;
+}
+
+size_t RecvBuffer::space() const {
+    return _capacity - _end;
+}
+
+void RecvBuffer::commit(size_t size) {
+    _end += std::min(size, _capacity - _end);
+}
+
+void RecvBuffer::release() {
+    if (empty()) {
+        _free();
+        _begin = _end = 0;
+    }
+}
+
+void RecvBuffer::_free() {
+    if (_data == nullptr) {
+        return;
+    }
+
+    if (_capacity == BufferPool::block_size) {
+        BufferPool::instance().release(_data);
+    } else {
+        delete[] _data;
+    }
+    _data = nullptr;
+    _capacity = 0;
+}
+
+}
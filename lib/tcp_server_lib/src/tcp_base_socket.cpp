@@ -3,6 +3,7 @@
 using namespace bstcp;
 
 #include <iostream>
+#include <cerrno>
 
 BaseSocket::~BaseSocket() {
     _status = status::disconnected;
@@ -31,7 +32,7 @@ status BaseSocket::init(uint32_t host, uint16_t port, uint16_t type) {
 }
 
 status BaseSocket::_init_as_client(uint32_t host, uint16_t port, uint16_t type) {
-    if ((_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_IP)) < 0) {
+    if ((_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_IP)) < 0) {
         return _status = status::err_socket_init;
     }
 
@@ -43,23 +44,41 @@ status BaseSocket::_init_as_client(uint32_t host, uint16_t port, uint16_t type)
 
     if (connect(_socket, (sockaddr *) &_address, sizeof(_address)) != 0) {
         close(_socket);
+        _socket = -1;
         return _status = status::err_socket_connect;
     }
 
     int flags = fcntl(_socket, F_GETFL, 0);
     if (flags == -1) {
         close(_socket);
+        _socket = -1;
         return _status = status::err_socket_init;
     }
     flags = (type & (uint16_t)SocketType::nonblocking_socket) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
     if (fcntl(_socket, F_SETFL, flags) != 0) {
         close(_socket);
+        _socket = -1;
         return _status = status::err_socket_init;
     }
 
     return _status = status::connected;
 }
 
+status BaseSocket::attach(socket_t socket, uint16_t type) {
+    if (_status == status::connected) {
+        disconnect();
+    }
+
+    sock_len_t addrlen = sizeof(socket_addr_in);
+    if (getsockname(socket, (struct sockaddr *) &_address, &addrlen) == -1) {
+        return _status = status::err_socket_init;
+    }
+
+    _socket = socket;
+    _type = type;
+    return _status = status::connected;
+}
+
 status BaseSocket::accept(const std::unique_ptr<ISocket>& server_socket) {
     if (_status == status::connected) {
         disconnect();
@@ -67,7 +86,21 @@ status BaseSocket::accept(const std::unique_ptr<ISocket>& server_socket) {
 
     sock_len_t addrlen = sizeof(socket_addr_in);
     if ((_socket = accept4(server_socket->get_socket(), (struct sockaddr *) &_address,
-                           &addrlen, O_NONBLOCK)) < 0) {
+                           &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
+        return _status = status::disconnected;
+    }
+
+    return _status = status::connected;
+}
+
+status BaseSocket::adopt(socket_t socket) {
+    if (_status == status::connected) {
+        disconnect();
+    }
+
+    _socket = socket;
+    sock_len_t addrlen = sizeof(socket_addr_in);
+    if (getpeername(_socket, (struct sockaddr *) &_address, &addrlen) == -1) {
         return _status = status::disconnected;
     }
 
@@ -81,7 +114,8 @@ status BaseSocket::_init_as_server(uint32_t, uint16_t port, uint16_t type) {
     address.sin_family = AF_INET;
 
 
-    int type_ = SOCK_STREAM;
+    // Only listening sockets handed over on purpose reach other processes
+    int type_ = SOCK_STREAM | SOCK_CLOEXEC;
     if (type & (uint16_t)SocketType::nonblocking_socket) {
         type_ |= SOCK_NONBLOCK;
     }
@@ -94,6 +128,11 @@ status BaseSocket::_init_as_server(uint32_t, uint16_t port, uint16_t type) {
         return _status = status::err_socket_bind;
     }
 
+    if (int flag = true; (type & (uint16_t)SocketType::reuse_port)
+                         && setsockopt(_socket, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)) == -1)  {
+        return _status = status::err_socket_bind;
+    }
+
     if (bind(_socket, (struct sockaddr *) &address, sizeof(address)) < 0) {
         return _status = status::err_socket_bind;
     }
@@ -105,30 +144,79 @@ status BaseSocket::_init_as_server(uint32_t, uint16_t port, uint16_t type) {
     return _status = status::connected;
 }
 
-bool BaseSocket::recv_from(void *buffer, int size) {
-    if (_status != SocketStatus::connected)  {
-        return false;
+ssize_t BaseSocket::recv_from(void *buffer, size_t size) {
+    if (_status != SocketStatus::connected || size == 0)  {
+        return -1;
     }
 
-    ssize_t answ = recv(_socket, reinterpret_cast<char *>(buffer), size, 0);
-
-    if (answ <= 0 || !size) {
-        return false;
+    while (true) {
+        auto received = recv(_socket, reinterpret_cast<char *>(buffer), size, 0);
+        if (received > 0) {
+            return received;
+        }
+        if (received == 0) {
+            return -1;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
     }
+}
 
+bool BaseSocket::send_to(const void *buffer, int size) const {
+    // Succeeds only if all data is sent, partial sends are continued;
+    // non-blocking users should queue data and use send_some instead
+    auto data = reinterpret_cast<const char *>(buffer);
+    while (size > 0) {
+        auto sent = send_some(data, size);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= (int)sent;
+    }
     return true;
 }
 
-bool BaseSocket::send_to(const void *buffer, int size) const {
+ssize_t BaseSocket::send_some(const void *buffer, size_t size, bool more) const {
     if (_status != SocketStatus::connected) {
-        return false;
+        return -1;
     }
 
-    if (send(_socket, reinterpret_cast<const char *>(buffer), size, MSG_NOSIGNAL) < 0) {
-        return false;
+    int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+    while (true) {
+        auto sent = send(_socket, buffer, size, flags);
+        if (sent >= 0) {
+            return sent;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return errno == EAGAIN ? 0 : -1;
+    }
+}
+
+ssize_t BaseSocket::send_vector(const struct iovec *iov, size_t count, bool more) const {
+    if (_status != SocketStatus::connected) {
+        return -1;
     }
 
-    return true;
+    struct msghdr msg{};
+    msg.msg_iov = const_cast<struct iovec *>(iov);
+    msg.msg_iovlen = count;
+
+    int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+    while (true) {
+        auto sent = sendmsg(_socket, &msg, flags);
+        if (sent >= 0) {
+            return sent;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return errno == EAGAIN ? 0 : -1;
+    }
 }
 
 status BaseSocket::disconnect() {
@@ -0,0 +1,104 @@
+#include "work_stealing_deque.hpp"
+
+namespace prll {
+
+WorkStealingDeque::Array::Array(size_t capacity)
+        : capacity(capacity)
+        , items(new std::atomic<Task *>[capacity]) {}
+
+Task *WorkStealingDeque::Array::get(int64_t index) const {
+    return items[(size_t)index & (capacity - 1)].load(std::memory_order_relaxed);
+}
+
+void WorkStealingDeque::Array::put(int64_t index, Task *task) {
+    items[(size_t)index & (capacity - 1)].store(task, std::memory_order_relaxed);
+}
+
+WorkStealingDeque::Array *
+WorkStealingDeque::Array::grow(int64_t top, int64_t bottom) const {
+    auto *res = new Array(capacity * 2);
+    for (auto i = top; i < bottom; ++i) {
+        res->put(i, get(i));
+    }
+    return res;
+}
+
+WorkStealingDeque::WorkStealingDeque(size_t capacity)
+        : _top(0)
+        , _bottom(0) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    _array.store(new Array(size), std::memory_order_relaxed);
+}
+
+WorkStealingDeque::~WorkStealingDeque() {
+    delete _array.load(std::memory_order_relaxed);
+}
+
+void WorkStealingDeque::push(Task *task) {
+    auto bottom = _bottom.load(std::memory_order_relaxed);
+    auto top = _top.load(std::memory_order_acquire);
+    auto *array = _array.load(std::memory_order_relaxed);
+
+    if (bottom - top > (int64_t)array->capacity - 1) {
+        _retired.emplace_back(array);
+        array = array->grow(top, bottom);
+        _array.store(array, std::memory_order_release);
+    }
+
+    // Release store rather than a fence, which ThreadSanitizer does not model
+    array->put(bottom, task);
+    _bottom.store(bottom + 1, std::memory_order_release);
+}
+
+Task *WorkStealingDeque::take() {
+    auto bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    auto *array = _array.load(std::memory_order_relaxed);
+    _bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto top = _top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    auto *task = array->get(bottom);
+    if (top == bottom) {
+        // Last task, race with thieves for it
+        if (!_top.compare_exchange_strong(top, top + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+Task *WorkStealingDeque::steal() {
+    auto top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto bottom = _bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    auto *task = _array.load(std::memory_order_acquire)->get(top);
+    if (!_top.compare_exchange_strong(top, top + 1,
+                                      std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return task;
+}
+
+bool WorkStealingDeque::empty() const {
+    return _bottom.load(std::memory_order_relaxed)
+           <= _top.load(std::memory_order_relaxed);
+}
+
+}
@@ -2,4 +2,11 @@
 
 #include "include/tcp_utilits.hpp"
 #include "include/tcp_server.hpp"
-#include "include/tcp_base_socket.hpp"
\ No newline at end of file
+#include "include/tcp_base_socket.hpp"
+#include "include/file_range.hpp"
+#include "include/output_queue.hpp"
+#include "include/recv_buffer.hpp"
+#include "include/connection.hpp"
+#include "include/coroutine_client.hpp"
+#include "include/metrics.hpp"
+#include "include/handover.hpp"
\ No newline at end of file
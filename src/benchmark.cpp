@@ -0,0 +1,512 @@
+#include "tcp_server_lib.hpp"
+
+#include <sys/epoll.h>
+#include <arpa/inet.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace bstcp;
+
+namespace fs = std::filesystem;
+typedef std::chrono::steady_clock bench_clock_t;
+
+struct options_t {
+    std::string                 host        = "127.0.0.1";
+    uint16_t                    port        = 8081;
+    size_t                      connections = 64;
+    size_t                      threads     = std::thread::hardware_concurrency();
+    long                        duration    = 10;
+    bool                        keep_alive  = true;
+    size_t                      pipeline    = 1;
+    std::string                 root        = "httptest";
+    std::vector<std::string>    files;
+    std::string                 output;
+};
+
+// Log-linear histogram of latencies in microseconds with 32 sub-buckets
+// per power of two, so any percentile is within about 3% of the value
+class LatencyHistogram {
+  public:
+    void record(uint64_t value) {
+        ++_counts[_index(value)];
+        ++_total;
+        _sum += value;
+        _max = std::max(_max, value);
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (size_t i = 0; i < buckets_count; ++i) {
+            _counts[i] += other._counts[i];
+        }
+        _total += other._total;
+        _sum += other._sum;
+        _max = std::max(_max, other._max);
+    }
+
+    [[nodiscard]] uint64_t percentile(double q) const {
+        if (_total == 0) {
+            return 0;
+        }
+
+        auto rank = (uint64_t)std::ceil(q * (double)_total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets_count; ++i) {
+            seen += _counts[i];
+            if (seen >= rank && _counts[i] != 0) {
+                return std::min(_value(i), _max);
+            }
+        }
+        return _max;
+    }
+
+    [[nodiscard]] double mean() const {
+        return _total == 0 ? 0 : (double)_sum / (double)_total;
+    }
+
+    [[nodiscard]] uint64_t max() const {
+        return _max;
+    }
+
+  private:
+    static const size_t sub_bits = 5;
+    static const size_t buckets_count = (64 - sub_bits + 1) << sub_bits;
+
+    static size_t _index(uint64_t value) {
+        if (value < (2u << sub_bits)) {
+            return value;
+        }
+        size_t exponent = 63 - __builtin_clzll(value) - sub_bits;
+        return ((exponent + 1) << sub_bits)
+               + ((value >> exponent) - (1u << sub_bits));
+    }
+
+    // Upper bound of values in the bucket
+    static uint64_t _value(size_t index) {
+        if (index < (2u << sub_bits)) {
+            return index;
+        }
+        size_t exponent = (index >> sub_bits) - 1;
+        uint64_t mantissa = (index & ((1u << sub_bits) - 1)) + (1u << sub_bits);
+        return (mantissa << exponent) + (1ull << exponent) - 1;
+    }
+
+    std::array<uint64_t, buckets_count> _counts{};
+    uint64_t                            _total  = 0;
+    uint64_t                            _sum    = 0;
+    uint64_t                            _max    = 0;
+};
+
+struct stats_t {
+    LatencyHistogram    latency;
+    uint64_t            responses   = 0;
+    uint64_t            non_2xx     = 0;
+    uint64_t            errors      = 0;
+    uint64_t            bytes       = 0;
+};
+
+struct connection_t {
+    BaseSocket              socket;
+    std::string             output;
+    size_t                  sent        = 0;
+    std::string             input;
+    size_t                  awaited     = 0;
+    size_t                  next_file   = 0;
+    bool                    closing     = false;
+    bench_clock_t::time_point sent_at;
+};
+
+static std::string encode_url(const std::string &path) {
+    static const char *hex = "0123456789ABCDEF";
+    std::string res;
+    for (unsigned char ch: path) {
+        if (isalnum(ch) || ch == '/' || ch == '.' || ch == '-' || ch == '_') {
+            res += (char)ch;
+        } else {
+            res += '%';
+            res += hex[ch >> 4];
+            res += hex[ch & 15];
+        }
+    }
+    return res;
+}
+
+static std::vector<std::string> find_files(const std::string &root) {
+    std::vector<std::string> files;
+    std::error_code error;
+    for (auto &entry: fs::recursive_directory_iterator(root, error)) {
+        if (entry.is_regular_file()) {
+            files.push_back("/" + encode_url(entry.path().generic_string()));
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static std::vector<std::string> split(const std::string &list) {
+    std::vector<std::string> res;
+    std::stringstream stream(list);
+    for (std::string item; std::getline(stream, item, ',');) {
+        if (!item.empty()) {
+            res.push_back(item);
+        }
+    }
+    return res;
+}
+
+// Value of a header in response head, name is given in lower case
+static std::string_view find_header(std::string_view head, std::string_view name) {
+    for (size_t pos = head.find("\r\n"); pos != std::string_view::npos;
+         pos = head.find("\r\n", pos + 2)) {
+        auto line = head.substr(pos + 2, head.find("\r\n", pos + 2) - pos - 2);
+        if (line.size() <= name.size() || line[name.size()] != ':') {
+            continue;
+        }
+
+        bool equal = true;
+        for (size_t i = 0; i < name.size() && equal; ++i) {
+            equal = tolower(line[i]) == name[i];
+        }
+        if (equal) {
+            auto value = line.substr(name.size() + 1);
+            return value.substr(std::min(value.find_first_not_of(' '), value.size()));
+        }
+    }
+    return {};
+}
+
+class Worker {
+  public:
+    Worker(const options_t &options, uint32_t host, size_t connections, size_t first_file)
+            : _options(options)
+            , _host(host)
+            , _connections(connections)
+            , _epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {
+        for (size_t i = 0; i < connections; ++i) {
+            _connections[i].next_file = first_file + i;
+        }
+    }
+
+    Worker(const Worker&) = delete;
+    Worker operator=(const Worker&) = delete;
+
+    ~Worker() {
+        close(_epoll_fd);
+    }
+
+    void run(bench_clock_t::time_point deadline) {
+        for (size_t i = 0; i < _connections.size(); ++i) {
+            _connect(i);
+        }
+
+        std::array<struct epoll_event, 256> events{};
+        while (bench_clock_t::now() < deadline) {
+            auto count = epoll_wait(_epoll_fd, events.data(), (int)events.size(), 100);
+            for (int i = 0; i < count; ++i) {
+                _process(events[i].data.u64);
+            }
+        }
+    }
+
+    [[nodiscard]] const stats_t &get_stats() const {
+        return _stats;
+    }
+
+  private:
+    void _connect(size_t index) {
+        auto &conn = _connections[index];
+        conn.socket = BaseSocket();
+        conn.input.clear();
+        conn.output.clear();
+        conn.sent = conn.awaited = 0;
+        conn.closing = false;
+
+        if (conn.socket.init(_host, _options.port,
+                             (uint16_t) SocketType::client_socket
+                             | (uint16_t) SocketType::nonblocking_socket)
+            != status::connected) {
+            ++_stats.errors;
+            return;
+        }
+
+        int flag = 1;
+        setsockopt(conn.socket.get_socket(), IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+        struct epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.u64 = index;
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, conn.socket.get_socket(), &ev);
+
+        _send_batch(conn);
+    }
+
+    void _reconnect(size_t index) {
+        _connections[index].socket.disconnect();
+        _connect(index);
+    }
+
+    void _send_batch(connection_t &conn) {
+        auto depth = _options.keep_alive ? _options.pipeline : 1;
+        for (size_t i = 0; i < depth; ++i) {
+            auto &file = _options.files[conn.next_file++ % _options.files.size()];
+            conn.output += "GET " + file + " HTTP/1.1\r\nHost: " + _options.host + "\r\n";
+            if (!_options.keep_alive) {
+                conn.output += "Connection: close\r\n";
+            }
+            conn.output += "\r\n";
+        }
+        conn.awaited = depth;
+        conn.sent_at = bench_clock_t::now();
+    }
+
+    // Returns false if the connection is broken
+    bool _flush(connection_t &conn) {
+        while (conn.sent < conn.output.size()) {
+            auto sent = conn.socket.send_some(conn.output.data() + conn.sent,
+                                              conn.output.size() - conn.sent);
+            if (sent < 0) {
+                return false;
+            }
+            if (sent == 0) {
+                return true;
+            }
+            conn.sent += sent;
+        }
+        conn.output.clear();
+        conn.sent = 0;
+        return true;
+    }
+
+    // Parses complete responses, returns false on malformed input
+    bool _parse_responses(connection_t &conn) {
+        size_t pos = 0;
+        while (conn.awaited > 0) {
+            auto view = std::string_view(conn.input).substr(pos);
+            auto end = view.find("\r\n\r\n");
+            if (end == std::string_view::npos) {
+                break;
+            }
+
+            auto head = view.substr(0, end + 2);
+            auto length = strtoul(std::string(find_header(head, "content-length")).c_str(),
+                                  nullptr, 10);
+            if (view.size() < end + 4 + length) {
+                break;
+            }
+            if (view.size() < 12 || view.substr(0, 5) != "HTTP/") {
+                return false;
+            }
+
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                    bench_clock_t::now() - conn.sent_at).count();
+            _stats.latency.record((uint64_t)latency);
+            ++_stats.responses;
+            if (view[9] != '2') {
+                ++_stats.non_2xx;
+            }
+            _stats.bytes += end + 4 + length;
+
+            // Server may close keep-alive connection, e.g. after request limit
+            auto connection = find_header(head, "connection");
+            if (connection.size() == 5 && tolower(connection[0]) == 'c') {
+                conn.closing = true;
+            }
+
+            pos += end + 4 + length;
+            --conn.awaited;
+        }
+        conn.input.erase(0, pos);
+        return true;
+    }
+
+    void _process(size_t index) {
+        auto &conn = _connections[index];
+        if (!_flush(conn)) {
+            ++_stats.errors;
+            _reconnect(index);
+            return;
+        }
+
+        char buffer[64 * 1024];
+        bool closed = false;
+        while (true) {
+            auto received = conn.socket.recv_from(buffer, sizeof(buffer));
+            if (received == 0) {
+                break;
+            }
+            if (received < 0) {
+                closed = true;
+                break;
+            }
+            conn.input.append(buffer, received);
+        }
+
+        if (!_parse_responses(conn)) {
+            ++_stats.errors;
+            _reconnect(index);
+            return;
+        }
+
+        if (conn.awaited == 0) {
+            if (!_options.keep_alive || closed || conn.closing) {
+                _reconnect(index);
+                return;
+            }
+            _send_batch(conn);
+            if (!_flush(conn)) {
+                ++_stats.errors;
+                _reconnect(index);
+            }
+            return;
+        }
+
+        if (closed) {
+            ++_stats.errors;
+            _reconnect(index);
+        }
+    }
+
+    const options_t             &_options;
+    uint32_t                    _host;
+    std::vector<connection_t>   _connections;
+    int                         _epoll_fd;
+    stats_t                     _stats;
+};
+
+static void print_usage(const char *name) {
+    std::cerr << "Usage: " << name << " [-h host] [-p port] [-c connections]"
+              << " [-t threads] [-d seconds] [-k 0|1] [-P depth]"
+              << " [-r root] [-f path,path...] [-o output.json]" << std::endl;
+}
+
+static void write_report(std::ostream &out, const options_t &options,
+                         const stats_t &stats, double seconds) {
+    auto &latency = stats.latency;
+    out << "{\n"
+        << "  \"connections\": " << options.connections << ",\n"
+        << "  \"threads\": " << options.threads << ",\n"
+        << "  \"duration_s\": " << seconds << ",\n"
+        << "  \"keep_alive\": " << (options.keep_alive ? "true" : "false") << ",\n"
+        << "  \"pipeline\": " << options.pipeline << ",\n"
+        << "  \"files\": " << options.files.size() << ",\n"
+        << "  \"responses\": " << stats.responses << ",\n"
+        << "  \"non_2xx\": " << stats.non_2xx << ",\n"
+        << "  \"errors\": " << stats.errors << ",\n"
+        << "  \"bytes\": " << stats.bytes << ",\n"
+        << "  \"rps\": " << (uint64_t)((double)stats.responses / seconds) << ",\n"
+        << "  \"latency_us\": {\n"
+        << "    \"mean\": " << (uint64_t)latency.mean() << ",\n"
+        << "    \"p50\": " << latency.percentile(0.5) << ",\n"
+        << "    \"p90\": " << latency.percentile(0.9) << ",\n"
+        << "    \"p99\": " << latency.percentile(0.99) << ",\n"
+        << "    \"p999\": " << latency.percentile(0.999) << ",\n"
+        << "    \"max\": " << latency.max() << "\n"
+        << "  }\n"
+        << "}" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    options_t options;
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "h:p:c:t:d:k:P:r:f:o:")) != -1) {
+        switch (opt) {
+            case 'h':
+                options.host = optarg;
+                break;
+            case 'p':
+                options.port = (uint16_t)strtoul(optarg, nullptr, 10);
+                break;
+            case 'c':
+                options.connections = strtoul(optarg, nullptr, 10);
+                break;
+            case 't':
+                options.threads = strtoul(optarg, nullptr, 10);
+                break;
+            case 'd':
+                options.duration = strtol(optarg, nullptr, 10);
+                break;
+            case 'k':
+                options.keep_alive = strtol(optarg, nullptr, 10) != 0;
+                break;
+            case 'P':
+                options.pipeline = std::max(1ul, strtoul(optarg, nullptr, 10));
+                break;
+            case 'r':
+                options.root = optarg;
+                break;
+            case 'f':
+                options.files = split(optarg);
+                break;
+            case 'o':
+                options.output = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    struct in_addr host{};
+    if (inet_pton(AF_INET, options.host.c_str(), &host) != 1) {
+        std::cerr << "Host must be an IPv4 address: " << options.host << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (options.files.empty()) {
+        options.files = find_files(options.root);
+    }
+    if (options.files.empty()) {
+        std::cerr << "No files to request in " << options.root << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    options.threads = std::clamp(options.threads, 1ul, std::max(1ul, options.connections));
+    std::cerr << "Running " << options.duration << "s test @ " << options.host
+              << ":" << options.port << " with " << options.connections
+              << " connections on " << options.threads << " threads, "
+              << options.files.size() << " files" << std::endl;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < options.threads; ++i) {
+        auto count = options.connections / options.threads
+                     + (i < options.connections % options.threads ? 1 : 0);
+        workers.emplace_back(new Worker(options, host.s_addr, count, i * 7));
+    }
+
+    auto start = bench_clock_t::now();
+    auto deadline = start + std::chrono::seconds(options.duration);
+    std::vector<std::thread> threads;
+    for (auto &worker: workers) {
+        threads.emplace_back([&worker, deadline] { worker->run(deadline); });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    auto seconds = std::chrono::duration<double>(bench_clock_t::now() - start).count();
+
+    stats_t total;
+    for (auto &worker: workers) {
+        auto &stats = worker->get_stats();
+        total.latency.merge(stats.latency);
+        total.responses += stats.responses;
+        total.non_2xx += stats.non_2xx;
+        total.errors += stats.errors;
+        total.bytes += stats.bytes;
+    }
+
+    if (options.output.empty()) {
+        write_report(std::cout, options, total, seconds);
+    } else {
+        std::ofstream out(options.output);
+        write_report(out, options, total, seconds);
+    }
+    return total.responses > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -2,51 +2,183 @@
 #include "file_client_lib.hpp"
 
 #include <iostream>
+#include <csignal>
 #include <getopt.h>
 
 using namespace bstcp;
 
 
-//Parse ip to std::string
-std::string getHostStr(const std::unique_ptr<IServerClient> &client) {
-    uint32_t ip = client->get_host();
-    return std::string() + std::to_string(int(reinterpret_cast<unsigned char *>(&ip)[0])) + '.' +
-           std::to_string(int(reinterpret_cast<unsigned char *>(&ip)[1])) + '.' +
-           std::to_string(int(reinterpret_cast<unsigned char *>(&ip)[2])) + '.' +
-           std::to_string(int(reinterpret_cast<unsigned char *>(&ip)[3])) + ':' +
-           std::to_string(client->get_port());
-}
+// Time a new process has to start serving on reload
+static const auto handover_timeout = std::chrono::seconds(10);
 
 int main(int argc, char *argv[]) {
     int opt = 0;
 
     int http_port = 8081;
-    while ((opt = getopt(argc, argv, "p:")) != -1) {
-        if (opt == 'p') {
-            http_port = (int)strtol(optarg, nullptr, 10);
+    long keep_alive_timeout = 15;
+    Poller::timeouts_t timeouts;
+    size_t max_requests = 1000;
+    size_t thread_count = std::thread::hardware_concurrency();
+    bool multi_reactor = false;
+    bool use_io_uring = false;
+    long cache_size_mb = 64;
+    bool index_root = false;
+    auto body_source = file::BodySource::read;
+    std::string access_log;
+    long defer_accept = 0;
+    Poller::wait_config_t wait_config;
+    long drain_timeout = 30;
+    while ((opt = getopt(argc, argv, "p:k:r:t:mc:uib:l:d:e:aw:s:q:o:g:")) != -1) {
+        switch (opt) {
+            case 'p':
+                http_port = (int)strtol(optarg, nullptr, 10);
+                break;
+            case 'k':
+                keep_alive_timeout = strtol(optarg, nullptr, 10);
+                break;
+            case 'r':
+                max_requests = strtoul(optarg, nullptr, 10);
+                break;
+            case 't':
+                thread_count = strtoul(optarg, nullptr, 10);
+                break;
+            case 'm':
+                multi_reactor = true;
+                break;
+            case 'c':
+                cache_size_mb = strtol(optarg, nullptr, 10);
+                break;
+            case 'u':
+                use_io_uring = true;
+                break;
+            case 'i':
+                index_root = true;
+                break;
+            case 'b':
+                if (std::string(optarg) == "mmap") {
+                    body_source = file::BodySource::mmap;
+                }
+                break;
+            case 'l':
+                access_log = optarg;
+                break;
+            case 'd':
+                defer_accept = strtol(optarg, nullptr, 10);
+                break;
+            case 'e':
+                wait_config.max_events = strtoul(optarg, nullptr, 10);
+                break;
+            case 'a':
+                wait_config.adaptive = true;
+                break;
+            case 'w':
+                wait_config.timeout = std::chrono::milliseconds(strtol(optarg, nullptr, 10));
+                break;
+            case 's':
+                wait_config.busy_poll = std::chrono::microseconds(strtol(optarg, nullptr, 10));
+                break;
+            case 'q':
+                timeouts.header = std::chrono::seconds(strtol(optarg, nullptr, 10));
+                break;
+            case 'o':
+                timeouts.write = std::chrono::seconds(strtol(optarg, nullptr, 10));
+                break;
+            case 'g':
+                drain_timeout = strtol(optarg, nullptr, 10);
+                break;
+            default:
+                break;
         }
     }
 
-    try {
-        BaseTcpServer<file::FileClient> server(http_port,
-                         {1, 1, 1}, // Keep alive{idle:1s, interval: 1s, pk_count: 1}
+    // Taken by sigwait below, blocked before any thread starts:
+    // SIGTERM drains, SIGUSR2 hands sockets to a new process and drains,
+    // SIGINT stops at once
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    file::FileClient::set_max_requests(max_requests);
+    file::Filesystem::current().set_cache_limits(cache_size_mb * 1024 * 1024,
+                                                 1024 * 1024);
+    file::Filesystem::set_body_source(body_source);
 
-                         [](const std::unique_ptr<IServerClient> &client) { // Connect handler
-                             std::cout << "Client " << getHostStr(client) << " connected\n";
-                         },
+    // Before any thread starts, as SIGHUP has to be blocked in all of them
+    if (index_root && !file::Filesystem::current().enable_manifest()) {
+        std::cerr << "Document root could not be indexed, files are looked up"
+                     " on each request" << std::endl;
+    }
 
-                         [](const std::unique_ptr<IServerClient> &client) { // Disconnect handler
-                             std::cout << "Client " << getHostStr(client) << " disconnected\n";
-                         },
+    // Starts the writer thread, so only after SIGHUP is blocked
+    if (!access_log.empty() && !file::AccessLog::open(access_log)) {
+        std::cerr << "Access log " << access_log << " could not be opened" << std::endl;
+    }
 
-                         20//std::thread::hardware_concurrency() // Thread pool size
+    try {
+        using Server = CoroutineTcpServer<file::FileClient>;
+        // Connections are recorded by the access log
+        Server server(http_port,
+                      {1, 1, 1}, // Keep alive{idle:1s, interval: 1s, pk_count: 1}
+                      Server::_default_connsection_handler,
+                      Server::_default_connsection_handler,
+                      thread_count // Thread pool size
         );
 
+        Metrics::add_gauge("httpd_connections", "Open client connections",
+                           [&server] { return (double)server.get_client_stats().in_use; });
+        Metrics::add_gauge("httpd_client_slots", "Client slots allocated in pools",
+                           [&server] { return (double)server.get_client_stats().capacity; });
+
+        timeouts.idle = std::chrono::seconds(keep_alive_timeout);
+        server.set_timeouts(timeouts);
+        server.set_defer_accept(std::chrono::seconds(defer_accept));
+        server.set_wait_config(wait_config);
+        if (use_io_uring) {
+            server.set_poller(PollerType::io_uring);
+        }
+        if (multi_reactor) {
+            // One event loop with own listening socket per thread
+            server.set_event_loops(thread_count);
+        }
+        server.set_inherited_sockets(Handover::take_sockets());
+
         //Start server
-        if (server.start() == BaseTcpServer<file::FileClient>::ServerStatus::up) {
+        if (server.start() == Server::ServerStatus::up) {
             std::cout << "Server listen on port: " << server.get_port() << std::endl
-                      << "Server run on events: " << 20 << std::endl;
-            server.joinLoop();
+                      << "Server run on threads: " << thread_count
+                      << (multi_reactor ? " (event loop per thread)" : "")
+                      << std::endl
+                      << "Server uses: "
+                      << (server.get_poller_type() == PollerType::io_uring
+                          ? "io_uring" : "epoll")
+                      << std::endl;
+            if (auto manifest = file::Filesystem::current().get_manifest()) {
+                std::cout << "Files indexed: " << manifest->get_files_count()
+                          << " (reloaded on SIGHUP and changes)" << std::endl;
+            }
+            Handover::notify_ready();
+
+            int signal = 0;
+            while (sigwait(&signals, &signal) == 0 && signal == SIGUSR2) {
+                if (Handover::spawn(argv, server.get_listen_sockets(),
+                                    handover_timeout) != -1) {
+                    std::cout << "Sockets handed over, draining" << std::endl;
+                    signal = SIGTERM;
+                    break;
+                }
+                std::cerr << "New process did not start, keep serving" << std::endl;
+            }
+
+            if (signal != SIGINT
+                && !server.drain(std::chrono::seconds(drain_timeout))) {
+                std::cerr << "Connections still busy after " << drain_timeout
+                          << "s are closed" << std::endl;
+            }
+            server.stop();
+            file::AccessLog::close();
             return EXIT_SUCCESS;
         } else {
             std::cout << "Server start error! Error code:" << int(server.get_status()) << std::endl;